@@ -0,0 +1,34 @@
+# bench.pri - settings shared by the benchmark targets in bench/
+#
+# Each benchmark .pro file sets TARGET and SOURCES and includes this file.
+
+TEMPLATE = app
+CONFIG += qt warn_on release console
+CONFIG -= app_bundle
+QT = core gui xml
+
+INCLUDEPATH += $$PWD/../src
+
+# Program modules which are benchmarked
+SOURCES += $$PWD/../src/treeparser.cpp \
+           $$PWD/../src/function.cpp \
+           $$PWD/../src/polyline.cpp \
+           $$PWD/../src/sampler.cpp \
+           $$PWD/../src/parallel.cpp \
+           $$PWD/../src/implicit.cpp
+
+HEADERS += $$PWD/../src/treeparser.h \
+           $$PWD/../src/function.h \
+           $$PWD/../src/polyline.h \
+           $$PWD/../src/sampler.h \
+           $$PWD/../src/parallel.h \
+           $$PWD/../src/implicit.h
+
+# Everything build-related goes into build/, as with the main program,
+# regardless of the directory qmake is run in
+UI_DIR = $$PWD/../build/$$TARGET/
+MOC_DIR = $$PWD/../build/$$TARGET/
+OBJECTS_DIR = $$PWD/../build/$$TARGET/
+RCC_DIR = $$PWD/../build/$$TARGET/
+
+DESTDIR = $$PWD/../bin/
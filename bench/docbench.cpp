@@ -0,0 +1,575 @@
+/* docbench.cpp - implements the document benchmark, which times whole documents
+                  through opening, rendering of frames and export.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "common.h"
+#include "function.h"
+#include "plot.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QImage>
+#include <QPixmap>
+#include <QPainter>
+#include <QDir>
+#include <QFile>
+#include <QDomDocument>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+
+/*
+ *  Unlike microbench, which times the parts in isolation, this benchmark times what the user
+ *  waits for: opening a document, the first frame after opening, frames while panning and
+ *  exporting to a file. It runs on documents of 1 to several thousand functions, which gives
+ *  a scaling curve of the whole pipeline.
+ *
+ *  Each repetition starts from scratch - a new FunctionDB and a new PlotArea - so that
+ *  the first frame really is the first one.
+ *
+ *  The documents are generated deterministically (see generateDocument()), so the corpus
+ *  doesn't have to be kept in the repository; it is written to a directory on the first run
+ *  and reused afterwards.
+ *
+ *  Results are written as JSON. Given a baseline (the JSON output of a previous run),
+ *  the metrics are compared with it and the program fails if any of them got slower
+ *  than the threshold allows.
+ *
+ */
+
+
+// Number of frames timed while panning in each repetition
+const int PAN_FRAMES = 4;
+
+
+// -------- Corpus --------
+
+
+// Expressions of cartesian functions; "A" and "B" are replaced with coefficients
+static const char *CARTESIAN_TEMPLATES[] = {
+  "A*x + B",
+  "A*x^2 - B",
+  "A*sin(B*x)",
+  "A*cos(x/B) + sin(B*x)/2",
+  "A*exp(-x^2/B)",
+  "A*x^3/B - x",
+  "A*atan(B*x)",
+  "A*sqrt(abs(B*x))",
+  "sin(A*x) * cos(x/B) * B" };
+static const int CARTESIAN_TEMPLATES_SIZE = sizeof CARTESIAN_TEMPLATES / sizeof *CARTESIAN_TEMPLATES;
+
+// Expressions of implicit functions
+static const char *IMPLICIT_TEMPLATES[] = {
+  "x^2 + y^2 - A*B",
+  "x^2/A + y^2/B - 4",
+  "sin(x/A) * cos(y/A) - 1/B" };
+static const int IMPLICIT_TEMPLATES_SIZE = sizeof IMPLICIT_TEMPLATES / sizeof *IMPLICIT_TEMPLATES;
+
+// Expressions of parametric functions, as x and y pairs
+static const char *PARAMETRIC_TEMPLATES[][2] = {
+  { "A*cos t", "B*sin t" },
+  { "A*sin(3*t)", "B*sin(2*t)" },
+  { "A*cos(4*t)*cos t", "A*cos(4*t)*sin t" } };
+static const int PARAMETRIC_TEMPLATES_SIZE = sizeof PARAMETRIC_TEMPLATES / sizeof *PARAMETRIC_TEMPLATES;
+
+//! Returns the name of index-th function of a generated document
+/** Names may contain only letters, so the index is written in base 26. */
+QString corpusFunctionName(int index)
+{
+  QString name;
+  for (int i = 0; i < 4; ++i)
+  {
+    name.prepend(QChar('a' + index % 26));
+    index /= 26;
+  }
+  return QString("q") + name;
+}
+
+//! Substitutes the coefficients of index-th function into the template
+QString corpusExpression(const char *expressionTemplate, int index)
+{
+  double a = 0.5 + ((index * 37) % 100) / 25.0;
+  double b = 1.0 + ((index * 53) % 70) / 10.0;
+
+  QString expression(expressionTemplate);
+  expression.replace("A", QString().setNum(a, 'g', 6));
+  expression.replace("B", QString().setNum(b, 'g', 6));
+  return expression;
+}
+
+//! Appends the element \a name with the text \a value to \a element
+static void appendProperty(QDomDocument &document, QDomElement &element, const QString &name,
+                           const QString &value)
+{
+  QDomElement propertyElement = document.createElement(name);
+  element.appendChild(propertyElement);
+  propertyElement.appendChild(document.createTextNode(value));
+}
+
+//! Generates a document of \a count functions and saves it as \a fileName
+/** The document is mostly cartesian functions, every tenth of which calls one
+    of the others; one in 50 functions is parametric and one in 500 implicit.
+    It is written as XML directly: adding the functions to a FunctionDB one by one
+    would parse all of them again with each one (see FunctionDB::addFunction()). */
+bool generateDocument(const QString &fileName, int count)
+{
+  QDomDocument document;
+  QDomElement root = document.createElement("mplotdoc");
+  document.appendChild(root);
+
+  for (int i = 0; i < count; ++i)
+  {
+    QDomElement function = document.createElement("function");
+    root.appendChild(function);
+
+    QString type;
+    if (i % 500 == 9)
+      type = "implicit";
+    else if (i % 50 == 4)
+      type = "parametric";
+    else
+      type = "cartesian";
+
+    appendProperty(document, function, "type", type);
+    appendProperty(document, function, "name", corpusFunctionName(i));
+    appendProperty(document, function, "width", QString().setNum(1.0 + (i % 3) * 0.5));
+
+    if (type == "implicit")
+    {
+      appendProperty(document, function, "formula", corpusExpression(
+          IMPLICIT_TEMPLATES[(i / 500) % IMPLICIT_TEMPLATES_SIZE], i));
+      appendProperty(document, function, "method", "quadtree");
+    }
+    else if (type == "parametric")
+    {
+      const char **templates = PARAMETRIC_TEMPLATES[(i / 50) % PARAMETRIC_TEMPLATES_SIZE];
+      appendProperty(document, function, "x_formula", corpusExpression(templates[0], i));
+      appendProperty(document, function, "y_formula", corpusExpression(templates[1], i));
+      appendProperty(document, function, "min_param", QString().setNum(0.0));
+      appendProperty(document, function, "max_param", QString().setNum(2.0 * M_PI, 'g', 17));
+      appendProperty(document, function, "param_step", QString().setNum(0.01));
+    }
+    else
+    {
+      QString expression;
+      // Functions 0 to 3 are always cartesian and don't call others, so they can be called
+      if ((i % 10 == 7) && (i >= 10))
+        expression = QString("%1(x/2) + %2").arg(corpusFunctionName(i % 4)).arg(i % 5);
+      else
+        expression = corpusExpression(CARTESIAN_TEMPLATES[i % CARTESIAN_TEMPLATES_SIZE], i);
+      appendProperty(document, function, "formula", expression);
+    }
+  }
+
+  QByteArray output = document.toByteArray();
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  if (file.write(output) != output.size())
+    return false;
+
+  file.close();
+  return true;
+}
+
+
+// -------- Running and reporting --------
+
+
+//! \struct ViewParams A viewport size and zoom, at which documents are rendered
+struct ViewParams
+{
+  int width, height;
+  double scale;
+
+  //! Name as used in the result keys, e.g. "1280x800@40"
+  QString name() const
+  { return QString("%1x%2@%3").arg(width).arg(height).arg(scale, 0, 'g', 6); }
+};
+
+//! Returns the median of the \a samples, which are sorted in the process
+double median(vector<double> &samples)
+{
+  if (samples.empty())
+    return 0.0;
+
+  sort(samples.begin(), samples.end());
+  double result = samples[samples.size() / 2];
+  if (samples.size() % 2 == 0)
+    result = 0.5 * (result + samples[samples.size() / 2 - 1]);
+
+  return result;
+}
+
+//! Returns the JSON result of one metric
+QJsonObject makeResult(const QString &key, const QString &document, int functions,
+                       const QString &metric, const QString &view, vector<double> &samples)
+{
+  double med = median(samples);
+
+  QJsonObject result;
+  result.insert("key", key);
+  result.insert("document", document);
+  result.insert("functions", functions);
+  result.insert("metric", metric);
+  if (!view.isEmpty())
+    result.insert("view", view);
+  result.insert("repetitions", static_cast<int>(samples.size()));
+  result.insert("ms", med);
+  result.insert("ms_min", samples.empty() ? 0.0 : samples.front());
+  result.insert("ms_max", samples.empty() ? 0.0 : samples.back());
+
+  return result;
+}
+
+//! Converts the elapsed time of \a timer to milliseconds
+inline double elapsedMs(const QElapsedTimer &timer)
+{ return timer.nsecsElapsed() / 1e6; }
+
+//! Parses a comma-separated list of numbers
+QList<double> parseNumberList(const QString &text)
+{
+  QList<double> result;
+  QStringList items = text.split(',');
+  for (int i = 0; i < items.size(); ++i)
+  {
+    bool ok = false;
+    double value = items.at(i).trimmed().toDouble(&ok);
+    if (ok && (value > 0.0))
+      result.append(value);
+  }
+  return result;
+}
+
+//! Parses a comma-separated list of viewport sizes, such as "640x480,1280x800"
+QList<QSize> parseSizeList(const QString &text)
+{
+  QList<QSize> result;
+  QStringList items = text.split(',');
+  for (int i = 0; i < items.size(); ++i)
+  {
+    QStringList dimensions = items.at(i).trimmed().split('x');
+    if (dimensions.size() != 2)
+      continue;
+
+    int w = dimensions.at(0).toInt();
+    int h = dimensions.at(1).toInt();
+    if ((w > 0) && (h > 0))
+      result.append(QSize(w, h));
+  }
+  return result;
+}
+
+//! Renders \a plot into \a frame once the functions of its current view are drawn
+void renderComplete(PlotArea *plot, QImage &frame)
+{
+  // The first render starts drawing the functions in the background
+  plot->render(&frame);
+  while (plot->isRendering())
+    QThread::msleep(1);
+  plot->render(&frame);
+}
+
+/** Times opening of the document, first frame, panning and export at the given view
+    and appends the times of each repetition to the vectors */
+void runRepetition(const QString &fileName, const ViewParams &view, const QString &exportFileName,
+                   vector<double> &openMs, vector<double> &firstFrameMs,
+                   vector<double> &panFrameMs, vector<double> &exportMs)
+{
+  QElapsedTimer timer;
+
+  // Open - the same as MainWindow does
+  timer.start();
+  FunctionDB *functionDB = new FunctionDB();
+  if (!functionDB->openFile(fileName))
+    fprintf(stderr, "Could not open '%s'\n", fileName.toLocal8Bit().constData());
+  openMs.push_back(elapsedMs(timer));
+
+  PlotArea *plot = new PlotArea(NULL);
+  plot->resize(view.width, view.height);
+  plot->setUnitScale(view.scale);
+  // Auto axis unit is what the user usually sees; this also recomputes it for the new size
+  plot->setManualAxisUnitF(false);
+
+  QImage frame(view.width, view.height, QImage::Format_ARGB32_Premultiplied);
+
+  timer.start();
+  renderComplete(plot, frame);
+  firstFrameMs.push_back(elapsedMs(timer));
+
+  // Panning by a tenth of the view, as with the arrow keys
+  double panStep = view.width / (10.0 * view.scale);
+  double panMs = 0.0;
+  for (int i = 1; i <= PAN_FRAMES; ++i)
+  {
+    timer.start();
+    plot->setTranslateX(i * panStep);
+    renderComplete(plot, frame);
+    panMs += elapsedMs(timer);
+  }
+  panFrameMs.push_back(panMs / PAN_FRAMES);
+
+  // Export of the initial view, the same as MainWindow does
+  ExportData data;
+  data.fileName = exportFileName;
+  data.scale = view.scale;
+  data.xMin = -0.5 * view.width / view.scale;
+  data.xMax = 0.5 * view.width / view.scale;
+  data.yMin = -0.5 * view.height / view.scale;
+  data.yMax = 0.5 * view.height / view.scale;
+
+  timer.start();
+  if (plot->exportPlot(data))
+    data.pixmap->save(data.fileName);
+  exportMs.push_back(elapsedMs(timer));
+
+  delete data.pixmap;
+  data.pixmap = NULL;
+
+  delete plot;
+  plot = NULL;
+  delete functionDB;
+  functionDB = NULL;
+}
+
+//! Compares the \a results with \a baseline and returns the number of regressions
+/** A metric has regressed if it is slower than its baseline by more than \a threshold
+    (relative) and more than \a minDelta milliseconds. */
+int compareWithBaseline(const QJsonArray &results, const QJsonArray &baseline,
+                        double threshold, double minDelta)
+{
+  QMap<QString, double> baselineMs;
+  for (int i = 0; i < baseline.size(); ++i)
+  {
+    QJsonObject object = baseline.at(i).toObject();
+    baselineMs.insert(object.value("key").toString(), object.value("ms").toDouble());
+  }
+
+  int regressions = 0, compared = 0;
+  for (int i = 0; i < results.size(); ++i)
+  {
+    QJsonObject object = results.at(i).toObject();
+    QString key = object.value("key").toString();
+    if (!baselineMs.contains(key))
+      continue;
+
+    ++compared;
+    double base = baselineMs.value(key);
+    double current = object.value("ms").toDouble();
+    if ((current > base * (1.0 + threshold)) && (current - base > minDelta))
+    {
+      fprintf(stderr, "REGRESSION %s: %.3f ms -> %.3f ms (%+.1f%%)\n",
+              key.toLocal8Bit().constData(), base, current,
+              (base > 0.0) ? (100.0 * (current - base) / base) : 100.0);
+      ++regressions;
+    }
+  }
+
+  fprintf(stderr, "Compared %d metrics with baseline, %d regressed\n", compared, regressions);
+  return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+  // No window is ever shown, so there's no need for a display
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+  QApplication a(argc, argv);
+  QCoreApplication::setApplicationName("docbench");
+
+  QCommandLineParser cmdLine;
+  cmdLine.setApplicationDescription("QMPlot benchmark of whole documents: opening, "
+                                    "first frame, panning and export");
+  cmdLine.addHelpOption();
+
+  QCommandLineOption corpusOption("corpus", "Directory of the generated documents; they are "
+                                  "generated if missing.", "dir",
+                                  QDir(QDir::tempPath()).filePath("qmplot-docbench"));
+  QCommandLineOption generateOption("generate-only", "Only generate the documents and exit.");
+  QCommandLineOption documentsOption("documents", "Comma-separated numbers of functions "
+                                     "in the documents.", "list", "1,10,100,1000,5000");
+  QCommandLineOption viewportsOption("viewports", "Comma-separated viewport sizes.",
+                                     "list", "640x480,1280x800");
+  QCommandLineOption zoomsOption("zooms", "Comma-separated pixel scales.", "list", "10,40,160");
+  QCommandLineOption warmupOption("warmup", "Number of untimed repetitions.", "n", "1");
+  QCommandLineOption repeatOption("repeat", "Number of timed repetitions.", "n", "3");
+  QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                  "Write JSON results to file instead of standard output.", "file");
+  QCommandLineOption baselineOption("baseline", "Compare results with the JSON output "
+                                    "of a previous run and fail on regressions.", "file");
+  QCommandLineOption thresholdOption("threshold", "Allowed slowdown against the baseline, "
+                                     "in percent.", "percent", "15");
+  QCommandLineOption minDeltaOption("min-delta", "Slowdowns smaller than this are never "
+                                    "regressions, in milliseconds.", "ms", "1");
+  cmdLine.addOption(corpusOption);
+  cmdLine.addOption(generateOption);
+  cmdLine.addOption(documentsOption);
+  cmdLine.addOption(viewportsOption);
+  cmdLine.addOption(zoomsOption);
+  cmdLine.addOption(warmupOption);
+  cmdLine.addOption(repeatOption);
+  cmdLine.addOption(outputOption);
+  cmdLine.addOption(baselineOption);
+  cmdLine.addOption(thresholdOption);
+  cmdLine.addOption(minDeltaOption);
+  cmdLine.process(a);
+
+  int warmup = qMax(0, cmdLine.value(warmupOption).toInt());
+  int repetitions = qMax(1, cmdLine.value(repeatOption).toInt());
+  double threshold = qMax(0.0, cmdLine.value(thresholdOption).toDouble() / 100.0);
+  double minDelta = qMax(0.0, cmdLine.value(minDeltaOption).toDouble());
+
+  QList<double> documentSizes = parseNumberList(cmdLine.value(documentsOption));
+  QList<QSize> viewports = parseSizeList(cmdLine.value(viewportsOption));
+  QList<double> zooms = parseNumberList(cmdLine.value(zoomsOption));
+  if (documentSizes.isEmpty() || viewports.isEmpty() || zooms.isEmpty())
+  {
+    fprintf(stderr, "Empty list of documents, viewports or zooms\n");
+    return 1;
+  }
+
+  QDir corpusDir(cmdLine.value(corpusOption));
+  if (!corpusDir.mkpath("."))
+  {
+    fprintf(stderr, "Could not create corpus directory '%s'\n",
+            corpusDir.path().toLocal8Bit().constData());
+    return 1;
+  }
+
+  QStringList documentNames;
+  for (int i = 0; i < documentSizes.size(); ++i)
+  {
+    int count = static_cast<int>(documentSizes.at(i));
+    QString documentName = QString("doc_%1.qmplot").arg(count);
+    QString fileName = corpusDir.filePath(documentName);
+    if (!QFile::exists(fileName))
+    {
+      fprintf(stderr, "Generating %s\n", fileName.toLocal8Bit().constData());
+      if (!generateDocument(fileName, count))
+      {
+        fprintf(stderr, "Could not write '%s'\n", fileName.toLocal8Bit().constData());
+        return 1;
+      }
+    }
+    documentNames.append(documentName);
+  }
+
+  if (cmdLine.isSet(generateOption))
+    return 0;
+
+  QString exportFileName = corpusDir.filePath("export.png");
+
+  QJsonArray results;
+  for (int d = 0; d < documentNames.size(); ++d)
+  {
+    QString documentName = documentNames.at(d);
+    QString fileName = corpusDir.filePath(documentName);
+    int functions = static_cast<int>(documentSizes.at(d));
+
+    vector<double> openMs;
+
+    for (int v = 0; v < viewports.size(); ++v)
+    {
+      for (int z = 0; z < zooms.size(); ++z)
+      {
+        ViewParams view;
+        view.width = viewports.at(v).width();
+        view.height = viewports.at(v).height();
+        view.scale = zooms.at(z);
+
+        fprintf(stderr, "%s %s\n", documentName.toLocal8Bit().constData(),
+                view.name().toLocal8Bit().constData());
+
+        vector<double> dummyOpen, firstFrameMs, panFrameMs, exportMs;
+        for (int i = 0; i < warmup; ++i)
+          runRepetition(fileName, view, exportFileName, dummyOpen, firstFrameMs, panFrameMs, exportMs);
+
+        firstFrameMs.clear();
+        panFrameMs.clear();
+        exportMs.clear();
+        for (int i = 0; i < repetitions; ++i)
+          runRepetition(fileName, view, exportFileName, openMs, firstFrameMs, panFrameMs, exportMs);
+
+        QString prefix = documentName + "/";
+        QString suffix = "/" + view.name();
+        results.append(makeResult(prefix + "first_frame" + suffix, documentName, functions,
+                                  "first_frame", view.name(), firstFrameMs));
+        results.append(makeResult(prefix + "pan_frame" + suffix, documentName, functions,
+                                  "pan_frame", view.name(), panFrameMs));
+        results.append(makeResult(prefix + "export" + suffix, documentName, functions,
+                                  "export", view.name(), exportMs));
+      }
+    }
+
+    // Opening doesn't depend on the view, so all repetitions make up one metric
+    results.append(makeResult(documentName + "/open", documentName, functions,
+                              "open", QString(), openMs));
+  }
+
+  QFile::remove(exportFileName);
+
+  QJsonObject root;
+  root.insert("suite", QString("docbench"));
+  root.insert("qt_version", QString(qVersion()));
+  root.insert("warmup", warmup);
+  root.insert("repetitions", repetitions);
+  root.insert("results", results);
+
+  QByteArray output = QJsonDocument(root).toJson();
+
+  if (cmdLine.isSet(outputOption))
+  {
+    QFile file(cmdLine.value(outputOption));
+    if ((!file.open(QIODevice::WriteOnly)) || (file.write(output) != output.size()))
+    {
+      fprintf(stderr, "Could not write results to '%s'\n",
+              file.fileName().toLocal8Bit().constData());
+      return 1;
+    }
+    file.close();
+  }
+  else
+  {
+    fwrite(output.constData(), 1, output.size(), stdout);
+  }
+
+  if (cmdLine.isSet(baselineOption))
+  {
+    QFile file(cmdLine.value(baselineOption));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+      fprintf(stderr, "Could not read baseline '%s'\n",
+              file.fileName().toLocal8Bit().constData());
+      return 1;
+    }
+
+    QJsonDocument baseline = QJsonDocument::fromJson(file.readAll());
+    file.close();
+    if (!baseline.isObject())
+    {
+      fprintf(stderr, "Invalid baseline '%s'\n", file.fileName().toLocal8Bit().constData());
+      return 1;
+    }
+
+    if (compareWithBaseline(results, baseline.object().value("results").toArray(),
+                            threshold, minDelta) > 0)
+      return 2;
+  }
+
+  return 0;
+}
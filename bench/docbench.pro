@@ -0,0 +1,20 @@
+TARGET = docbench
+
+include(bench.pri)
+
+# The whole drawing pipeline is benchmarked, including the widget
+QT += widgets svg
+
+SOURCES += $$PWD/../src/plot.cpp \
+           $$PWD/../src/renderer.cpp \
+           $$PWD/../src/axes.cpp \
+           $$PWD/../src/exporter.cpp \
+           $$PWD/../src/tiffwriter.cpp \
+           docbench.cpp
+
+HEADERS += $$PWD/../src/common.h \
+           $$PWD/../src/plot.h \
+           $$PWD/../src/renderer.h \
+           $$PWD/../src/axes.h \
+           $$PWD/../src/exporter.h \
+           $$PWD/../src/tiffwriter.h
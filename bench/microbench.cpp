@@ -0,0 +1,495 @@
+/* microbench.cpp - implements the microbenchmark suite, which times the parser,
+                    the evaluator and the paint paths of functions in isolation.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "treeparser.h"
+#include "function.h"
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+
+/*
+ *  Every benchmark is a class derived from Benchmark which implements run(). One call of run()
+ *  is one repetition; it returns the number of samples it processed, so that the results can be
+ *  given per sample. What a sample is depends on the benchmark and is reported as its unit.
+ *
+ *  The results are written as JSON, so that they can be compared between runs and builds.
+ *
+ */
+
+
+// Results of computations are accumulated here so that the compiler can't throw them away
+static volatile double benchmarkSink = 0.0;
+
+//! \class Benchmark Abstract base class for benchmarks
+class Benchmark
+{
+  public:
+    Benchmark(const QString &vKind, const QString &vName, const QString &vUnit)
+      : _kind(vKind), _name(vName), _unit(vUnit) {}
+    virtual ~Benchmark() {}
+
+    inline QString kind() const
+    { return _kind; }
+    inline QString name() const
+    { return _name; }
+    inline QString unit() const
+    { return _unit; }
+
+    //! Full name as used by the filter, e.g. "compute/trig_heavy"
+    inline QString fullName() const
+    { return _kind + "/" + _name; }
+
+    //! Runs one repetition and returns the number of samples processed
+    virtual qint64 run() = 0;
+
+  private:
+    QString _kind, _name, _unit;
+};
+
+//! \class ParseBenchmark Times TreeParser::setExpression()
+class ParseBenchmark : public Benchmark
+{
+  public:
+    ParseBenchmark(const QString &vName, const char *vExpression, int vCount)
+      : Benchmark("parse", vName, "expression"), _expression(vExpression), _count(vCount) {}
+
+    qint64 run()
+    {
+      TreeParser parser;
+      for (int i = 0; i < _count; ++i)
+        parser.setExpression(_expression);
+
+      return _count;
+    }
+
+  private:
+    std::string _expression;
+    int _count;
+};
+
+//! \class ComputeBenchmark Times TreeParser::computeValue() over a range of x (and y) values
+class ComputeBenchmark : public Benchmark
+{
+  public:
+    ComputeBenchmark(const QString &vName, const char *vExpression, int vCount)
+      : Benchmark("compute", vName, "evaluation"), _count(vCount)
+    {
+      _parser.setExpression(vExpression);
+    }
+
+    qint64 run()
+    {
+      double xVal = 0.0, yVal = 0.0;
+      _parser.setVariable("x", &xVal);
+      _parser.setVariable("y", &yVal);
+
+      double sum = 0.0;
+      for (int i = 0; i < _count; ++i)
+      {
+        xVal = -10.0 + 20.0 * i / _count;
+        yVal = 0.5 * xVal;
+
+        double val = 0.0;
+        if (_parser.computeValue(val).allOk())
+          sum += val;
+      }
+      benchmarkSink = benchmarkSink + sum;
+
+      _parser.unsetVariable("x");
+      _parser.unsetVariable("y");
+
+      return _count;
+    }
+
+  private:
+    TreeParser _parser;
+    int _count;
+};
+
+//! \class ExternalBenchmark Times FunctionDB::getFunctionValue() for a function from the corpus
+class ExternalBenchmark : public Benchmark
+{
+  public:
+    ExternalBenchmark(const QString &vName, int vCount)
+      : Benchmark("external", vName, "call"), _function(vName.toStdString()), _count(vCount) {}
+
+    qint64 run()
+    {
+      double sum = 0.0;
+      for (int i = 0; i < _count; ++i)
+      {
+        double val = 0.0;
+        if (FunctionDB::getFunctionValue(_function, -10.0 + 20.0 * i / _count, val))
+          sum += val;
+      }
+      benchmarkSink = benchmarkSink + sum;
+
+      return _count;
+    }
+
+  private:
+    std::string _function;
+    int _count;
+};
+
+//! \class PaintBenchmark Times Function::paint() into an offscreen image
+class PaintBenchmark : public Benchmark
+{
+  public:
+    PaintBenchmark(const QString &vKind, Function *vFunction, const QString &vUnit,
+                   qint64 vSamples, QImage &vImage, const FunctionPaintParams &vParams)
+      : Benchmark(vKind, vFunction->name(), vUnit), _function(vFunction),
+        _samples(vSamples), _image(vImage), _params(vParams) {}
+
+    qint64 run()
+    {
+      _image.fill(Qt::transparent);
+
+      QPainter p(&_image);
+      p.setRenderHints(QPainter::Antialiasing);
+      _function->paint(p, _params);
+      p.end();
+
+      return _samples;
+    }
+
+  protected:
+    Function *_function;
+    qint64 _samples;
+    QImage &_image;
+    FunctionPaintParams _params;
+};
+
+//! \class CartesianPaintBenchmark Times CartesianFunction::paint() without or with the cached values
+/** Without panning, each repetition starts with an empty cache, so all values are computed.
+  With panning, the view moves by PAN_STEP pixels after each repetition, so the values of the
+  columns still visible come from the cache and only the newly exposed ones are computed. */
+class CartesianPaintBenchmark : public PaintBenchmark
+{
+  public:
+    //! Distance in pixels by which the view moves between the repetitions when panning
+    static const int PAN_STEP = 32;
+
+    CartesianPaintBenchmark(CartesianFunction *vFunction, bool vPan, qint64 vSamples,
+                            QImage &vImage, const FunctionPaintParams &vParams)
+      : PaintBenchmark(vPan ? "paint_cartesian_pan" : "paint_cartesian", vFunction, "pixel",
+                       vSamples, vImage, vParams), _pan(vPan) {}
+
+    qint64 run()
+    {
+      if (_pan)
+        _params.xMin += PAN_STEP / _params.scale;
+      else
+        static_cast<CartesianFunction*>(_function)->clearSampleCache();
+
+      return PaintBenchmark::run();
+    }
+
+  private:
+    bool _pan;
+};
+
+
+// -------- Corpus --------
+
+
+//! \struct CorpusEntry An expression of the corpus
+struct CorpusEntry
+{
+  const char *name;
+  const char *expression;
+};
+
+/* Functions called by the expressions in the corpus. They are added to FunctionDB first,
+   because parsing an external function call requires the function to exist. */
+static const CorpusEntry HELPER_FUNCTIONS[] = {
+  { "u", "sin x" },
+  { "v", "u(x)^2 + x" },
+  { "w", "v(x) * u(x/2)" },
+  { "p", "x^3 - 2*x" } };
+
+// Cartesian functions y = f(x)
+static const CorpusEntry CARTESIAN_CORPUS[] = {
+  { "poly_linear", "2*x + 1" },
+  { "poly_cubic", "x^3 - 2*x^2 + x - 5" },
+  { "poly_high", "0.01*x^8 - 0.2*x^6 + x^4 - 3*x^2 + 2" },
+  { "trig_sin", "sin x" },
+  { "trig_mix", "sin(3*x) * cos(x/2) + tan(x/4)" },
+  { "trig_heavy", "sin(sin(x) + cos(2*x)) * exp(-abs(x)/5) + atan(sinh(x/3))" },
+  { "external_single", "p(x) + 1" },
+  { "external_nested", "w(v(u(x)))" } };
+
+// Implicit functions f(x, y) = 0
+static const CorpusEntry IMPLICIT_CORPUS[] = {
+  { "implicit_circle", "x^2 + y^2 - 16" },
+  { "implicit_ellipse", "x^2 + x*y + y^2 - 9" },
+  { "implicit_folium", "x^3 + y^3 - 6*x*y" },
+  { "implicit_waves", "sin x + cos y" } };
+
+//! \struct ParametricEntry A parametric function of the corpus
+struct ParametricEntry
+{
+  const char *name;
+  const char *xExpression, *yExpression;
+  double minParam, maxParam, paramStep;
+};
+
+static const ParametricEntry PARAMETRIC_CORPUS[] = {
+  { "param_circle", "4*cos t", "4*sin t", 0.0, 2.0 * M_PI, 0.01 },
+  { "param_lissajous", "6*sin(3*t)", "5*sin(4*t)", 0.0, 2.0 * M_PI, 0.001 },
+  { "param_rose", "6*cos(5*t)*cos t", "6*cos(5*t)*sin t", 0.0, 2.0 * M_PI, 0.001 },
+  { "param_spiral", "t/10*cos t", "t/10*sin t", 0.0, 100.0, 0.01 },
+  { "param_lissajous_long", "6*sin(3*t)", "5*sin(4*t)", 0.0, 200.0 * M_PI, 0.001 } };
+
+template<typename T, int N>
+inline int corpusSize(const T (&)[N])
+{ return N; }
+
+
+// -------- Running and reporting --------
+
+
+//! Runs the benchmark and returns its JSON result
+QJsonObject runBenchmark(Benchmark &benchmark, int warmup, int repetitions)
+{
+  for (int i = 0; i < warmup; ++i)
+    benchmark.run();
+
+  vector<double> nsPerSample;
+  qint64 samples = 0;
+  for (int i = 0; i < repetitions; ++i)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    samples = benchmark.run();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    if (samples > 0)
+      nsPerSample.push_back(static_cast<double>(elapsed) / samples);
+  }
+
+  QJsonObject result;
+  result.insert("kind", benchmark.kind());
+  result.insert("name", benchmark.name());
+  result.insert("unit", benchmark.unit());
+  result.insert("samples", static_cast<double>(samples));
+  result.insert("repetitions", repetitions);
+
+  if (nsPerSample.empty())
+    return result;
+
+  sort(nsPerSample.begin(), nsPerSample.end());
+  double median = nsPerSample[nsPerSample.size() / 2];
+  if (nsPerSample.size() % 2 == 0)
+    median = 0.5 * (median + nsPerSample[nsPerSample.size() / 2 - 1]);
+
+  result.insert("ns_per_sample", median);
+  result.insert("ns_per_sample_min", nsPerSample.front());
+  result.insert("ns_per_sample_max", nsPerSample.back());
+  result.insert("samples_per_sec", (median > 0.0) ? (1e9 / median) : 0.0);
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  // No window is ever shown, so there's no need for a display
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+  QGuiApplication a(argc, argv);
+  QCoreApplication::setApplicationName("microbench");
+
+  QCommandLineParser cmdLine;
+  cmdLine.setApplicationDescription("QMPlot microbenchmarks of parser, evaluator and paint paths");
+  cmdLine.addHelpOption();
+
+  QCommandLineOption warmupOption("warmup", "Number of untimed repetitions.", "n", "3");
+  QCommandLineOption repeatOption("repeat", "Number of timed repetitions.", "n", "15");
+  QCommandLineOption filterOption("filter", "Run only benchmarks containing this text "
+                                  "in the name, e.g. \"paint/\".", "text");
+  QCommandLineOption widthOption("width", "Width of the offscreen image.", "px", "800");
+  QCommandLineOption heightOption("height", "Height of the offscreen image.", "px", "600");
+  QCommandLineOption scaleOption("scale", "Pixel scale of the plot.", "scale", "40");
+  QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                  "Write JSON results to file instead of standard output.", "file");
+  cmdLine.addOption(warmupOption);
+  cmdLine.addOption(repeatOption);
+  cmdLine.addOption(filterOption);
+  cmdLine.addOption(widthOption);
+  cmdLine.addOption(heightOption);
+  cmdLine.addOption(scaleOption);
+  cmdLine.addOption(outputOption);
+  cmdLine.process(a);
+
+  int warmup = qMax(0, cmdLine.value(warmupOption).toInt());
+  int repetitions = qMax(1, cmdLine.value(repeatOption).toInt());
+  int width = qMax(1, cmdLine.value(widthOption).toInt());
+  int height = qMax(1, cmdLine.value(heightOption).toInt());
+  double scale = cmdLine.value(scaleOption).toDouble();
+  if (scale <= 0.0) scale = 40.0;
+  QString filter = cmdLine.value(filterOption);
+
+  // Functions must be added to the database before parsing expressions that call them
+  FunctionDB functionDB;
+
+  for (int i = 0; i < corpusSize(HELPER_FUNCTIONS); ++i)
+  {
+    CartesianFunction *function = static_cast<CartesianFunction*>(
+        functionDB.addFunction(FT_Cartesian, HELPER_FUNCTIONS[i].name));
+    function->formula().setExpression(HELPER_FUNCTIONS[i].expression);
+  }
+
+  QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+
+  FunctionPaintParams params;
+  params.area = QRect(0, 0, width, height);
+  params.scale = scale;
+  params.xMin = -0.5 * width / scale;
+  params.yMin = -0.5 * height / scale;
+
+  vector<Benchmark*> benchmarks;
+
+  for (int i = 0; i < corpusSize(CARTESIAN_CORPUS); ++i)
+  {
+    const CorpusEntry &entry = CARTESIAN_CORPUS[i];
+    benchmarks.push_back(new ParseBenchmark(entry.name, entry.expression, 1000));
+    benchmarks.push_back(new ComputeBenchmark(entry.name, entry.expression, 100000));
+
+    CartesianFunction *function = static_cast<CartesianFunction*>(
+        functionDB.addFunction(FT_Cartesian, entry.name));
+    function->formula().setExpression(entry.expression);
+    benchmarks.push_back(new ExternalBenchmark(entry.name, 100000));
+    benchmarks.push_back(new CartesianPaintBenchmark(function, false, width, image, params));
+    benchmarks.push_back(new CartesianPaintBenchmark(function, true, width, image, params));
+  }
+
+  for (int i = 0; i < corpusSize(IMPLICIT_CORPUS); ++i)
+  {
+    const CorpusEntry &entry = IMPLICIT_CORPUS[i];
+    benchmarks.push_back(new ParseBenchmark(entry.name, entry.expression, 1000));
+    benchmarks.push_back(new ComputeBenchmark(entry.name, entry.expression, 100000));
+
+    ImplicitFunction *function = static_cast<ImplicitFunction*>(
+        functionDB.addFunction(FT_Implicit, entry.name));
+    function->formula().setExpression(entry.expression);
+    function->method() = IM_Scan;
+    benchmarks.push_back(new PaintBenchmark("paint_implicit", function, "column",
+                                            width, image, params));
+
+    ImplicitFunction *quadtreeFunction = static_cast<ImplicitFunction*>(
+        functionDB.addFunction(FT_Implicit, QString(entry.name) + "_quadtree"));
+    quadtreeFunction->formula().setExpression(entry.expression);
+    quadtreeFunction->method() = IM_Quadtree;
+    benchmarks.push_back(new PaintBenchmark("paint_implicit", quadtreeFunction, "column",
+                                            width, image, params));
+
+    ImplicitFunction *rasterFunction = static_cast<ImplicitFunction*>(
+        functionDB.addFunction(FT_Implicit, QString(entry.name) + "_raster"));
+    rasterFunction->formula().setExpression(entry.expression);
+    rasterFunction->method() = IM_Raster;
+    benchmarks.push_back(new PaintBenchmark("paint_implicit", rasterFunction, "column",
+                                            width, image, params));
+
+    ImplicitFunction *traceFunction = static_cast<ImplicitFunction*>(
+        functionDB.addFunction(FT_Implicit, QString(entry.name) + "_trace"));
+    traceFunction->formula().setExpression(entry.expression);
+    traceFunction->method() = IM_Trace;
+    benchmarks.push_back(new PaintBenchmark("paint_implicit", traceFunction, "column",
+                                            width, image, params));
+  }
+
+  for (int i = 0; i < corpusSize(PARAMETRIC_CORPUS); ++i)
+  {
+    const ParametricEntry &entry = PARAMETRIC_CORPUS[i];
+
+    ParametricFunction *function = static_cast<ParametricFunction*>(
+        functionDB.addFunction(FT_Parametric, entry.name));
+    function->xFormula().setExpression(entry.xExpression);
+    function->yFormula().setExpression(entry.yExpression);
+    function->minParam() = entry.minParam;
+    function->maxParam() = entry.maxParam;
+    function->paramStep() = entry.paramStep;
+
+    qint64 steps = static_cast<qint64>(ceil((entry.maxParam - entry.minParam) / entry.paramStep));
+    benchmarks.push_back(new PaintBenchmark("paint_parametric", function, "step",
+                                            steps, image, params));
+
+    ParametricFunction *fixedFunction = static_cast<ParametricFunction*>(
+        functionDB.addFunction(FT_Parametric, QString(entry.name) + "_fixed"));
+    fixedFunction->xFormula().setExpression(entry.xExpression);
+    fixedFunction->yFormula().setExpression(entry.yExpression);
+    fixedFunction->minParam() = entry.minParam;
+    fixedFunction->maxParam() = entry.maxParam;
+    fixedFunction->paramStep() = entry.paramStep;
+    fixedFunction->adaptiveStep() = false;
+    benchmarks.push_back(new PaintBenchmark("paint_parametric", fixedFunction, "step",
+                                            steps, image, params));
+  }
+
+  QJsonArray results;
+  for (unsigned int i = 0; i < benchmarks.size(); ++i)
+  {
+    Benchmark *benchmark = benchmarks.at(i);
+    if ((!filter.isEmpty()) && (!benchmark->fullName().contains(filter)))
+      continue;
+
+    fprintf(stderr, "%s\n", benchmark->fullName().toLocal8Bit().constData());
+    results.append(runBenchmark(*benchmark, warmup, repetitions));
+  }
+
+  for (unsigned int i = 0; i < benchmarks.size(); ++i)
+    delete benchmarks.at(i);
+  benchmarks.clear();
+
+  QJsonObject imageObject;
+  imageObject.insert("width", width);
+  imageObject.insert("height", height);
+  imageObject.insert("scale", scale);
+
+  QJsonObject root;
+  root.insert("suite", QString("microbench"));
+  root.insert("qt_version", QString(qVersion()));
+  root.insert("warmup", warmup);
+  root.insert("repetitions", repetitions);
+  root.insert("image", imageObject);
+  root.insert("results", results);
+
+  QByteArray output = QJsonDocument(root).toJson();
+
+  if (cmdLine.isSet(outputOption))
+  {
+    QFile file(cmdLine.value(outputOption));
+    if ((!file.open(QIODevice::WriteOnly)) || (file.write(output) != output.size()))
+    {
+      fprintf(stderr, "Could not write results to '%s'\n",
+              file.fileName().toLocal8Bit().constData());
+      return 1;
+    }
+    file.close();
+  }
+  else
+  {
+    fwrite(output.constData(), 1, output.size(), stdout);
+  }
+
+  return 0;
+}
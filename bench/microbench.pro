@@ -0,0 +1,5 @@
+TARGET = microbench
+
+include(bench.pri)
+
+SOURCES += microbench.cpp
@@ -0,0 +1,265 @@
+/* qmplotrender.cpp - implements the command-line renderer, which draws QMPlot documents
+                      to image files without the user interface.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "common.h"
+#include "function.h"
+#include "renderer.h"
+#include "axes.h"
+#include "exporter.h"
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QDomDocument>
+#include <QFileInfo>
+#include <QImage>
+#include <QPainter>
+#include <QSvgGenerator>
+#include <QStringList>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+
+/*
+ *  The program draws a document the same way as the export of QMPlot: the grid, axes and
+ *  labels by PlotAxes and the functions by PlotExporter, in tiles on all cores, or straight
+ *  onto QSvgGenerator for SVG files, with the curves simplified.
+ *
+ *  Only QGuiApplication is created, on the offscreen platform unless another one is chosen,
+ *  so neither a display nor the widgets are needed and the startup takes milliseconds.
+ *  The times of the steps are printed to the standard output.
+ *
+ */
+
+
+inline double elapsedMs(const QElapsedTimer &timer)
+{ return timer.nsecsElapsed() / 1e6; }
+
+//! Parses the comma-separated view "xMin,xMax,yMin,yMax" into \a data
+bool parseView(const QString &text, ExportData &data)
+{
+  QStringList items = text.split(',');
+  if (items.size() != 4)
+    return false;
+
+  double values[4];
+  for (int i = 0; i < 4; ++i)
+  {
+    bool ok = false;
+    values[i] = items.at(i).trimmed().toDouble(&ok);
+    if (!ok) return false;
+  }
+
+  if ((values[1] <= values[0]) || (values[3] <= values[2]))
+    return false;
+
+  data.xMin = values[0];
+  data.xMax = values[1];
+  data.yMin = values[2];
+  data.yMax = values[3];
+  return true;
+}
+
+//! Parses the size "WxH" into \a width and \a height
+bool parseSize(const QString &text, int &width, int &height)
+{
+  QStringList dimensions = text.trimmed().split('x');
+  if (dimensions.size() != 2)
+    return false;
+
+  width = dimensions.at(0).toInt();
+  height = dimensions.at(1).toInt();
+  return (width > 0) && (height > 0);
+}
+
+//! Draws the functions of \a document in \a view over the background of \a image
+/** Returns the name of the function which caused recursion, else an empty string. */
+QString renderRaster(const RenderView &view, const QString &document, QImage &image)
+{
+  PlotExporter exporter;
+  exporter.exportArea(view, document, &image, image.rect());
+  exporter.wait();
+
+  return exporter.recursionFunction();
+}
+
+int main(int argc, char *argv[])
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  // No window is ever shown, so there's no need for a display
+  if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+
+  QGuiApplication a(argc, argv);
+  QCoreApplication::setApplicationName("qmplotrender");
+
+  QCommandLineParser cmdLine;
+  cmdLine.setApplicationDescription("Renders a QMPlot document to an image file without "
+                                    "the user interface");
+  cmdLine.addHelpOption();
+  cmdLine.addPositionalArgument("document", "QMPlot document to render.");
+  cmdLine.addPositionalArgument("output", "Image file to write; SVG for the .svg suffix, "
+                                "else a raster format chosen by the suffix (e.g. .png).");
+
+  ExportData defaults;
+  QCommandLineOption viewOption("view", "Comma-separated range of the plot: xMin,xMax,yMin,yMax.",
+                                "range", QString("%1,%2,%3,%4").arg(defaults.xMin).arg(defaults.xMax)
+                                                                .arg(defaults.yMin).arg(defaults.yMax));
+  QCommandLineOption scaleOption("scale", "Pixel scale (pixels per unit); the size of the image "
+                                 "follows from it and the range.", "scale",
+                                 QString::number(defaults.scale));
+  QCommandLineOption sizeOption("size", "Size of the image, e.g. 1280x800, instead of --scale; "
+                                "the range is centered and fit into it.", "WxH");
+  QCommandLineOption unitOption("unit", "Unit of the axes; chosen automatically if not given.", "unit");
+  cmdLine.addOption(viewOption);
+  cmdLine.addOption(scaleOption);
+  cmdLine.addOption(sizeOption);
+  cmdLine.addOption(unitOption);
+  cmdLine.process(a);
+
+  QStringList arguments = cmdLine.positionalArguments();
+  if (arguments.size() != 2)
+    cmdLine.showHelp(1);
+
+  QString documentName = arguments.at(0);
+  QString outputName = arguments.at(1);
+
+  ExportData data;
+  if (!parseView(cmdLine.value(viewOption), data))
+  {
+    fprintf(stderr, "Invalid view '%s'\n", cmdLine.value(viewOption).toLocal8Bit().constData());
+    return 1;
+  }
+
+  RenderView view;
+  if (cmdLine.isSet(sizeOption))
+  {
+    int width = 0, height = 0;
+    if (!parseSize(cmdLine.value(sizeOption), width, height))
+    {
+      fprintf(stderr, "Invalid size '%s'\n", cmdLine.value(sizeOption).toLocal8Bit().constData());
+      return 1;
+    }
+
+    // The whole range is visible and the image is centered on it
+    view.width = width;
+    view.height = height;
+    view.scale = qMin(width / (data.xMax - data.xMin), height / (data.yMax - data.yMin));
+    view.xMin = (data.xMax + data.xMin) * 0.5 - (width / view.scale) * 0.5;
+    view.yMin = (data.yMax + data.yMin) * 0.5 - (height / view.scale) * 0.5;
+  }
+  else
+  {
+    data.scale = cmdLine.value(scaleOption).toDouble();
+    if (!(data.scale > 0.0))
+    {
+      fprintf(stderr, "Invalid scale '%s'\n", cmdLine.value(scaleOption).toLocal8Bit().constData());
+      return 1;
+    }
+
+    view = PlotExporter::exportView(data);
+    if ((view.width <= 0) || (view.height <= 0))
+    {
+      fprintf(stderr, "The image would be empty\n");
+      return 1;
+    }
+  }
+
+  double startupMs = elapsedMs(timer);
+
+  timer.start();
+  FunctionDB functionDB;
+  if (!functionDB.openFile(documentName))
+  {
+    fprintf(stderr, "Could not open document '%s'\n", documentName.toLocal8Bit().constData());
+    return 1;
+  }
+
+  // The workers of PlotExporter read their own copies of the functions
+  QDomDocument document;
+  functionDB.saveDocument(document);
+  QString documentText = document.toString();
+  double loadMs = elapsedMs(timer);
+
+  timer.start();
+  PlotAxes axes;
+  double unit = cmdLine.isSet(unitOption) ? cmdLine.value(unitOption).toDouble() : axes.autoUnit(view);
+  if (!(unit > 0.0))
+  {
+    fprintf(stderr, "Invalid unit '%s'\n", cmdLine.value(unitOption).toLocal8Bit().constData());
+    return 1;
+  }
+
+  QString functionName;
+  bool written = false;
+  double renderMs = 0.0;
+  if (QFileInfo(outputName).suffix().toLower() == "svg")
+  {
+    // Written while it is painted, so both are timed as rendering
+    QSvgGenerator svg;
+    svg.setFileName(outputName);
+    svg.setSize(QSize(view.width, view.height));
+    svg.setViewBox(QRect(0, 0, view.width, view.height));
+    svg.setResolution(PlotExporter::VECTOR_RESOLUTION);
+    svg.setTitle("QMPlot plot");
+
+    QPainter p;
+    if (p.begin(&svg))
+    {
+      axes.paint(p, view, unit);
+      functionName = PlotRenderer::paintFunctions(p, view, QRect(0, 0, view.width, view.height),
+                                                  NULL, PlotExporter::VECTOR_TOLERANCE);
+      written = p.end();
+    }
+    renderMs = elapsedMs(timer);
+    timer.start();
+  }
+  else
+  {
+    QImage image(view.width, view.height, QImage::Format_RGB32);
+    if (image.isNull())
+    {
+      fprintf(stderr, "The image of %d x %d pixels is too large\n", view.width, view.height);
+      return 1;
+    }
+
+    QPainter p(&image);
+    axes.paint(p, view, unit);
+    p.end();
+
+    functionName = renderRaster(view, documentText, image);
+    renderMs = elapsedMs(timer);
+
+    timer.start();
+    if (functionName.isEmpty())
+      written = image.save(outputName);
+  }
+  double writeMs = elapsedMs(timer);
+
+  if (!functionName.isEmpty())
+  {
+    fprintf(stderr, "Recursion was detected while drawing function %s\n",
+            functionName.toLocal8Bit().constData());
+    return 1;
+  }
+
+  if (!written)
+  {
+    fprintf(stderr, "Could not write '%s'\n", outputName.toLocal8Bit().constData());
+    return 1;
+  }
+
+  printf("%s: %d x %d px, startup %.1f ms, load %.1f ms, render %.1f ms, write %.1f ms\n",
+         outputName.toLocal8Bit().constData(), view.width, view.height,
+         startupMs, loadMs, renderMs, writeMs);
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+# qmplotrender.pro - the command-line renderer of QMPlot documents
+#
+# It is a separate qmake project, built the same way as the benchmarks in bench/.
+
+TEMPLATE = app
+TARGET = qmplotrender
+CONFIG += qt warn_on release console
+CONFIG -= app_bundle
+# No widgets: only the modules drawing the plot and QSvgGenerator
+QT = core gui xml svg
+
+INCLUDEPATH += $$PWD/../src
+
+SOURCES += $$PWD/../src/treeparser.cpp \
+           $$PWD/../src/function.cpp \
+           $$PWD/../src/polyline.cpp \
+           $$PWD/../src/sampler.cpp \
+           $$PWD/../src/parallel.cpp \
+           $$PWD/../src/implicit.cpp \
+           $$PWD/../src/renderer.cpp \
+           $$PWD/../src/axes.cpp \
+           $$PWD/../src/exporter.cpp \
+           qmplotrender.cpp
+
+HEADERS += $$PWD/../src/common.h \
+           $$PWD/../src/treeparser.h \
+           $$PWD/../src/function.h \
+           $$PWD/../src/polyline.h \
+           $$PWD/../src/sampler.h \
+           $$PWD/../src/parallel.h \
+           $$PWD/../src/implicit.h \
+           $$PWD/../src/renderer.h \
+           $$PWD/../src/axes.h \
+           $$PWD/../src/exporter.h
+
+# Everything build-related goes into build/, as with the main program,
+# regardless of the directory qmake is run in
+MOC_DIR = $$PWD/../build/$$TARGET/
+OBJECTS_DIR = $$PWD/../build/$$TARGET/
+RCC_DIR = $$PWD/../build/$$TARGET/
+
+DESTDIR = $$PWD/../bin/
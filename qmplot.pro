@@ -1,11 +1,19 @@
 TEMPLATE = app
 CONFIG += qt warn_on debug
-QT = core gui widgets xml
+QT = core gui widgets xml svg
 
 SOURCES = src/main.cpp \
           src/treeparser.cpp \
           src/function.cpp \
+          src/polyline.cpp \
+          src/sampler.cpp \
+          src/parallel.cpp \
+          src/implicit.cpp \
           src/plot.cpp \
+          src/renderer.cpp \
+          src/axes.cpp \
+          src/exporter.cpp \
+          src/tiffwriter.cpp \
           src/dialogs.cpp \
           src/customcontrols.cpp \
           src/mainwindow.cpp
@@ -13,7 +21,15 @@ SOURCES = src/main.cpp \
 HEADERS = src/common.h \
           src/treeparser.h \
           src/function.h \
+          src/polyline.h \
+          src/sampler.h \
+          src/parallel.h \
+          src/implicit.h \
           src/plot.h \
+          src/renderer.h \
+          src/axes.h \
+          src/exporter.h \
+          src/tiffwriter.h \
           src/dialogs.h \
           src/customcontrols.h \
           src/mainwindow.h
@@ -0,0 +1,296 @@
+/* axes.cpp - implements the PlotAxes class, which draws the grid, axes and labels of plots.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "axes.h"
+
+#include <QPainter>
+#include <QPen>
+#include <QBrush>
+#include <QColor>
+#include <QVector>
+#include <QPolygonF>
+#include <QPointF>
+#include <QTransform>
+#include <cmath>
+
+using namespace std;
+
+// Useful shorthand
+const double SQRT_3 = sqrt(3.0);
+// Number of laid out axis labels above which they are laid out anew
+const int MAX_AXIS_LABELS = 512;
+
+const double PlotAxes::MIN_UNIT = 1e-12;
+
+
+PlotAxes::PlotAxes()
+{
+  _font = new QFont("Arial", 10, QFont::Bold);
+  _fontMetrics = new QFontMetrics(*_font);
+}
+
+PlotAxes::~PlotAxes()
+{
+  delete _font;
+  _font = NULL;
+  delete _fontMetrics;
+  _fontMetrics = NULL;
+}
+
+// A bit complex algorithm to find the appropriate units
+double PlotAxes::autoUnit(const RenderView &view)
+{
+  double unit = pow(10.0, ceil(-log10(view.scale * 0.5)) + 1.0);
+
+  double xMin = view.xMin;
+  double xMax = view.xMin + view.width / view.scale;
+  int ndiv = 0;
+  int prevAction = 0;
+  while (true)
+  {
+    double testX = abs(floor(max(abs(xMin), abs(xMax))) / unit) * unit;
+    int tw1 = axisLabel(QString().setNum(testX, 'g')).width;
+    int tw2 = axisLabel(QString().setNum(testX + unit, 'g')).width;
+    // Discovered through trial and error
+    if ((unit * view.scale - 0.25 * (tw1 + tw2) < 15.0) && (prevAction != 2))
+    {
+      prevAction = 1;
+      switch (ndiv)
+      {
+        case 0:
+        {
+          unit *= 2.0;
+          ndiv = 1;
+          break;
+        }
+        case 1:
+        {
+          unit *= (2.5/2.0);
+          ndiv = 2;
+          break;
+        }
+        case 2:
+        {
+          unit *= (5.0/2.5);
+          ndiv = 3;
+          break;
+        }
+        case 3:
+        {
+          unit *= (10.0/5.0);
+          ndiv = 0;
+          break;
+        }
+        default: {}
+      }
+    }
+    else if ((unit * view.scale - 0.25 * (tw1 + tw2) > (5.0 * ((tw1 + tw2) / 2.0))) && (prevAction != 1))
+    {
+      prevAction = 2;
+      switch (ndiv)
+      {
+        case 0:
+        {
+          unit /= 2.0;
+          ndiv = 1;
+          break;
+        }
+        case 1:
+        {
+          unit /= (2.5/2.0);
+          ndiv = 2;
+          break;
+        }
+        case 2:
+        {
+          unit /= (5.0/2.5);
+          ndiv = 3;
+          break;
+        }
+        case 3:
+        {
+          unit /= (10.0/5.0);
+          ndiv = 0;
+          break;
+        }
+        default: {}
+      }
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  return unit;
+}
+
+void PlotAxes::paint(QPainter &p, const RenderView &view, double unit)
+{
+  int width = view.width;
+  int height = view.height;
+  double scale = view.scale;
+
+  p.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
+  p.fillRect(QRect(0, 0, width, height), Qt::white);
+
+  QPen axisPen = p.pen();
+
+  QPen gridPen = p.pen();
+  gridPen.setColor(Qt::lightGray);
+  gridPen.setWidthF(0.5);
+
+  QPen borderFontPen = p.pen();
+  borderFontPen.setColor(QColor("#707070"));
+
+  p.setFont(*_font);
+  p.setBrush(QBrush(Qt::black));
+
+  double xMin = view.xMin;
+  double xMax = view.xMin + width / scale;
+  double yMin = view.yMin;
+  double yMax = view.yMin + height / scale;
+
+  // Positions of the axes in pixels
+  double xAxis = -xMin * scale;
+  double yAxis = height + yMin * scale;
+
+  int borderSize = _fontMetrics->height();
+
+  // Draw grid
+  p.setPen(gridPen);
+
+  for (double y = floor(yMin / unit) * unit; y < yMax; y += unit)
+    p.drawLine(QPointF(0.0, height - (y - yMin) * scale),
+               QPointF(width, height - (y - yMin) * scale));
+
+  for (double x = floor(xMin / unit) * unit; x < xMax; x += unit)
+    p.drawLine(QPointF((x - xMin) * scale, 0.0),
+               QPointF((x - xMin) * scale, height));
+
+  p.setPen(axisPen);
+
+  // Draw axis only if in view
+  if ((xAxis > 0.0) && (xAxis < width))
+  {
+    p.drawLine(QPointF(xAxis, 0.0), QPointF(xAxis, height));
+    // Arrow
+    QVector<QPointF> v;
+    v.push_back(QPointF(xAxis, 0.0));
+    v.push_back(QPointF(xAxis - 5.0, 5.0 * SQRT_3));
+    v.push_back(QPointF(xAxis + 5.0, 5.0 * SQRT_3));
+    p.drawConvexPolygon(QPolygonF(v));
+  }
+
+  // Draw labels - next to axis
+  if ((xAxis > 0.0) && (xAxis < width))
+  {
+    for (double y = floor(yMin / unit) * unit; y < yMax; y += unit)
+    {
+      p.drawLine(QPointF(xAxis - 2.0, height - (y - yMin) * scale),
+                 QPointF(xAxis + 2.0, height - (y - yMin) * scale));
+      if (fabs(y) > MIN_UNIT)
+      {
+        const AxisLabel &label = axisLabel(QString().setNum(y, 'g'));
+        p.drawStaticText(QPointF(xAxis + 5.0, height - (y - yMin) * scale - _fontMetrics->height() / 2.0),
+                         label.text);
+      }
+    }
+  }
+  // On the border
+  else
+  {
+    p.setPen(borderFontPen);
+    for (double y = floor(yMin / unit) * unit; y < yMax; y += unit)
+    {
+      if (fabs(y) > MIN_UNIT)
+      {
+        const AxisLabel &label = axisLabel(QString().setNum(y, 'g'));
+        if (label.width > borderSize)
+          borderSize = label.width;
+
+        if (xAxis > 0.0)
+        {
+          p.drawStaticText(QPointF(width - label.width,
+                                   height - (y - yMin) * scale - _fontMetrics->height() / 2.0),
+                           label.text);
+        }
+        else
+        {
+          p.drawStaticText(QPointF(0.0, height - (y - yMin) * scale - _fontMetrics->height() / 2.0),
+                           label.text);
+        }
+      }
+    }
+    p.setPen(axisPen);
+  }
+
+  if ((yAxis > 0.0) && (yAxis < height))
+  {
+    p.drawLine(QPointF(0.0, yAxis), QPointF(width, yAxis));
+    QVector<QPointF> v;
+    v.push_back(QPointF(width, yAxis));
+    v.push_back(QPointF(width - 5.0 * SQRT_3, yAxis + 5.0));
+    v.push_back(QPointF(width - 5.0 * SQRT_3, yAxis - 5.0));
+    p.drawConvexPolygon(QPolygonF(v));
+  }
+
+  if ((yAxis > 0.0) && (yAxis < height))
+  {
+    for (double x = floor(xMin / unit) * unit; x < xMax; x += unit)
+    {
+      p.drawLine(QPointF((x - xMin) * scale, yAxis - 2.0),
+                 QPointF((x - xMin) * scale, yAxis + 2.0));
+      if (fabs(x) > MIN_UNIT)
+      {
+        const AxisLabel &label = axisLabel(QString().setNum(x, 'g'));
+        p.drawStaticText(QPointF((x - xMin) * scale - label.width / 2.0, yAxis + 5.0), label.text);
+      }
+    }
+  }
+  else
+  {
+    p.setPen(borderFontPen);
+    for (double x = floor(xMin / unit) * unit; x < xMax; x += unit)
+    {
+      if (fabs(x) > MIN_UNIT)
+      {
+        const AxisLabel &label = axisLabel(QString().setNum(x, 'g'));
+        if (yAxis < 0.0)
+        {
+          p.drawStaticText(QPointF((x - xMin) * scale - label.width / 2.0, 0.0), label.text);
+        }
+        else
+        {
+          p.drawStaticText(QPointF((x - xMin) * scale - label.width / 2.0, height - _fontMetrics->height()),
+                           label.text);
+        }
+      }
+    }
+    p.setPen(axisPen);
+  }
+}
+
+const PlotAxes::AxisLabel& PlotAxes::axisLabel(const QString &text)
+{
+  QHash<QString, AxisLabel>::iterator it = _labels.find(text);
+  if (it != _labels.end())
+    return it.value();
+
+  // Labels of views long gone are dropped
+  if (_labels.size() >= MAX_AXIS_LABELS)
+    _labels.clear();
+
+  AxisLabel label;
+  label.text.setText(text);
+  label.text.setTextFormat(Qt::PlainText);
+  label.text.setPerformanceHint(QStaticText::AggressiveCaching);
+  label.text.prepare(QTransform(), *_font);
+  label.width = _fontMetrics->width(text);
+
+  return _labels.insert(text, label).value();
+}
@@ -0,0 +1,68 @@
+/* axes.h - defines the PlotAxes class, which draws the grid, axes and labels of plots.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_AXES_H
+#define _QMPLOT_AXES_H
+
+#include "renderer.h"
+
+#include <QString>
+#include <QHash>
+#include <QFont>
+#include <QFontMetrics>
+#include <QStaticText>
+
+class QPainter;
+
+//! \class PlotAxes Draws the grid, axes and labels of a plot and chooses the unit of the axes
+/** It isn't a widget, so plots can also be drawn without the user interface (see qmplotrender).
+  Labels are laid out once and kept for the next views. */
+class PlotAxes
+{
+  // Block copy constructor and assignment operator
+    PlotAxes(const PlotAxes &) {}
+    const PlotAxes& operator=(const PlotAxes &) { return *this; }
+
+  public:
+    //! Smallest unit of the axes; values closer to zero than this are at the origin
+    /** Lower units would be useless due to accuracy loss. */
+    static const double MIN_UNIT;
+
+    PlotAxes();
+    ~PlotAxes();
+
+    //! Returns the unit of the axes in \a view at which the labels are neither crowded nor sparse
+    double autoUnit(const RenderView &view);
+
+    //! Paints the background, grid, axes and labels of \a view with the given axis \a unit
+    void paint(QPainter &p, const RenderView &view, double unit);
+
+    //! Returns the font metrics of the labels
+    inline const QFontMetrics& fontMetrics() const
+    { return *_fontMetrics; }
+
+  private:
+    //! \struct AxisLabel A label of the axes, laid out for drawing
+    struct AxisLabel
+    {
+      QStaticText text;
+      //! Width of the text in pixels
+      int width;
+    };
+
+    //! Font for drawing units
+    QFont *_font;
+    //! Font metrics of the above
+    QFontMetrics *_fontMetrics;
+    //! Labels laid out so far, by their text
+    QHash<QString, AxisLabel> _labels;
+
+    //! Returns the label \a text, laying it out if it isn't in _labels yet
+    const AxisLabel& axisLabel(const QString &text);
+};
+
+#endif // _QMPLOT_AXES_H
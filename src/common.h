@@ -23,6 +23,7 @@ struct Settings
     numberPrecision = TreeParser::numberPrecision();
     language = 0;
     warnUnsavedNew = warnUnsavedAtExit = true;
+    tileCacheSize = 128;
   }
 
   //! Number format as a value of NumberFormat from TreeParser
@@ -35,6 +36,8 @@ struct Settings
   bool warnUnsavedNew;
   //! Whether to warn of unsaved changes at exit
   bool warnUnsavedAtExit;
+  //! Memory limit of the cache of drawn tiles of the plot in megabytes
+  int tileCacheSize;
 };
 
 class QPixmap;
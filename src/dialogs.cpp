@@ -143,10 +143,19 @@ ExportDialog::ExportDialog(QWidget *parent)
   QList<QByteArray> list = QImageWriter::supportedImageFormats();
   for (int i = 0; i < list.size(); ++i)
   {
+    // TIFF is written by PlotArea::exportPlotTiff()
+    QString format = QString(list[i]).toLower();
+    if ((format == "tif") || (format == "tiff")) continue;
+
     // E.g. "BMP files (*.bmp)"
-    filters << tr("%1 files (%2)").arg(QString(list[i]).toUpper())
-                 .arg(QString("*.") + QString(list[i]).toLower());
+    filters << tr("%1 files (%2)").arg(format.toUpper())
+                 .arg(QString("*.") + format);
   }
+  // Any size of image can be exported to TIFF
+  filters << tr("TIFF files (*.tif *.tiff)");
+  // Vector formats are written by PlotArea::exportPlotSvg() and exportPlotPdf()
+  filters << tr("SVG files (*.svg)");
+  filters << tr("PDF files (*.pdf)");
 
   // Add the any files option
   filters << tr("Any files (*.*)");
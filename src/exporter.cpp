@@ -0,0 +1,175 @@
+/* exporter.cpp - implements the PlotExporter class, which draws the functions of an exported
+                  image in tiles on all cores.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "exporter.h"
+#include "function.h"
+
+#include <QPainter>
+#include <QImage>
+#include <QMutexLocker>
+#include <QDomDocument>
+#include <cmath>
+
+
+const double PlotExporter::VECTOR_TOLERANCE = 0.25;
+
+
+PlotExporter::PlotExporter(QObject *parent) : QThread(parent)
+{
+  _image = NULL;
+  _columns = _rows = 0;
+  _complete = false;
+}
+
+PlotExporter::~PlotExporter()
+{
+  cancel();
+  wait();
+}
+
+void PlotExporter::exportArea(const RenderView &view, const QString &document, QImage *image,
+                              const QRect &area)
+{
+  Q_ASSERT(!isRunning());
+  Q_ASSERT((image != NULL) && (image->width() >= area.width()) && (image->height() >= area.height()));
+
+  _view = view;
+  _document = document;
+  _image = image;
+  _area = area;
+  _columns = (area.width() + PlotRenderer::TILE_SIZE - 1) / PlotRenderer::TILE_SIZE;
+  _rows = (area.height() + PlotRenderer::TILE_SIZE - 1) / PlotRenderer::TILE_SIZE;
+  _complete = false;
+  _recursionFunction.clear();
+  _cancel.store(0);
+  _nextTile.store(0);
+  _doneTiles.store(0);
+
+  // The image is detached here, so that the workers only write to it
+  _image->bits();
+
+  start();
+}
+
+bool PlotExporter::isComplete()
+{
+  QMutexLocker locker(&_mutex);
+
+  return _complete;
+}
+
+QString PlotExporter::recursionFunction()
+{
+  QMutexLocker locker(&_mutex);
+
+  return _recursionFunction;
+}
+
+RenderView PlotExporter::exportView(const ExportData &data)
+{
+  RenderView result;
+  result.width = static_cast<int>(floor((data.xMax - data.xMin) * data.scale));
+  result.height = static_cast<int>(floor((data.yMax - data.yMin) * data.scale));
+  // Centered on the exported area, like the view of the widget
+  result.xMin = (data.xMax + data.xMin) * 0.5 - (result.width / data.scale) * 0.5;
+  result.yMin = (data.yMax + data.yMin) * 0.5 - (result.height / data.scale) * 0.5;
+  result.scale = data.scale;
+  result.coarseness = 1;
+  return result;
+}
+
+void PlotExporter::cancel()
+{
+  _cancel.store(1);
+}
+
+void PlotExporter::run()
+{
+  int tiles = _columns * _rows;
+
+  // Each part is a worker, which takes the tiles until there are none left
+  int workers = parallelWorkerCount(tiles);
+  parallelFor(*this, workers, workers);
+
+  QMutexLocker locker(&_mutex);
+  _complete = (_cancel.load() == 0) && (_doneTiles.load() == tiles);
+}
+
+void PlotExporter::run(int, int)
+{
+  // Copy of the functions, used only by this worker
+  FunctionDB *functionDB = new FunctionDB(true);
+
+  QDomDocument domDocument;
+  if (domDocument.setContent(_document))
+    functionDB->readDocument(domDocument);
+
+  // All functions are drawn at once, so the margin must fit the widest line
+  double width = 0.0;
+  QList<Function*> functionList = functionDB->functionList();
+  for (int i = 0; i < functionList.size(); ++i)
+  {
+    if (functionList.at(i)->enabled())
+      width = qMax(width, functionList.at(i)->width());
+  }
+  int margin = PlotRenderer::tileMargin(width);
+
+  int tiles = _columns * _rows;
+  for (;;)
+  {
+    if (_cancel.load() != 0) break;
+
+    int tile = _nextTile.fetchAndAddOrdered(1);
+    if (tile >= tiles) break;
+
+    if (!exportTile(tile, margin)) break;
+
+    emit progress(_doneTiles.fetchAndAddOrdered(1) + 1, tiles);
+  }
+
+  delete functionDB;
+}
+
+bool PlotExporter::exportTile(int tile, int margin)
+{
+  QRect tileRect(_area.x() + (tile % _columns) * PlotRenderer::TILE_SIZE,
+                 _area.y() + (tile / _columns) * PlotRenderer::TILE_SIZE,
+                 PlotRenderer::TILE_SIZE, PlotRenderer::TILE_SIZE);
+  tileRect = tileRect.intersected(_area);
+
+  QRect marginRect = tileRect.adjusted(-margin, -margin, margin, margin);
+  QImage image(marginRect.size(), QImage::Format_ARGB32_Premultiplied);
+  image.fill(Qt::transparent);
+
+  QPainter p(&image);
+  p.setRenderHints(QPainter::Antialiasing);
+  p.translate(-marginRect.topLeft());
+  QString functionName = PlotRenderer::paintFunctions(p, _view, marginRect, &_cancel);
+  p.end();
+
+  if (!functionName.isEmpty())
+  {
+    QMutexLocker locker(&_mutex);
+    if (_recursionFunction.isEmpty())
+      _recursionFunction = functionName;
+    _cancel.store(1);
+    return false;
+  }
+
+  if (_cancel.load() != 0)
+    return false;
+
+  // Only one thread at a time may paint on the image
+  QMutexLocker locker(&_mutex);
+  QPainter imagePainter(_image);
+  imagePainter.drawImage(tileRect.topLeft() - _area.topLeft(), image,
+                         QRect(QPoint(margin, margin), tileRect.size()));
+  imagePainter.end();
+
+  return true;
+}
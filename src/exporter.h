@@ -0,0 +1,96 @@
+/* exporter.h - defines the PlotExporter class, which draws the functions of an exported
+                image in tiles on all cores.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_EXPORTER_H
+#define _QMPLOT_EXPORTER_H
+
+#include "common.h"
+#include "renderer.h"
+#include "parallel.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QString>
+#include <QRect>
+
+class QImage;
+
+//! \class PlotExporter Draws the functions of a part of an exported image in a background thread
+/** The part is split into tiles of PlotRenderer::TILE_SIZE pixels aligned to its top left corner,
+  which are drawn in parallel (see parallelFor()). Each worker reads the document into its own
+  FunctionDB, so the functions are computed without sharing any state between threads.
+
+  Each tile is drawn on its own image with a margin, so lines crossing its edges are complete,
+  and then put on the exported image. The tiles don't depend on the number of workers or
+  on the order in which they are drawn, so neither does the image. */
+class PlotExporter : public QThread, private ParallelTask
+{
+  Q_OBJECT
+
+  public:
+    //! Resolution of SVG and PDF files in pixels of the plot per inch
+    static const int VECTOR_RESOLUTION = 96;
+    //! Distance in pixels by which the curves exported to SVG and PDF may be simplified
+    static const double VECTOR_TOLERANCE;
+
+    PlotExporter(QObject *parent = NULL);
+    //! Cancels the export and waits for the thread to finish
+    ~PlotExporter();
+
+    //! Starts drawing the functions of \a document in the part \a area of \a view on \a image
+    /** \a image holds only \a area and must stay valid until the thread has finished.
+        The functions are drawn over its contents. */
+    void exportArea(const RenderView &view, const QString &document, QImage *image, const QRect &area);
+
+    //! Returns true if all tiles of the last export were drawn
+    bool isComplete();
+    //! Returns the name of the function which caused recursion in the last export, if any
+    QString recursionFunction();
+
+    //! Returns the view of the image exported with \a data
+    static RenderView exportView(const ExportData &data);
+
+  public slots:
+    //! Stops drawing the tiles
+    void cancel();
+
+  signals:
+    //! Emitted by the workers when \a done of \a count tiles are drawn
+    void progress(int done, int count);
+
+  protected:
+    void run();
+
+  private:
+    //! Draws the tiles taken one by one by the worker \a worker
+    void run(int index, int worker);
+
+    //! Draws the tile \a tile of the part with \a margin pixels around it and puts it on the image
+    /** Returns false if it was cancelled or recursion was detected. */
+    bool exportTile(int tile, int margin);
+
+    //! Guards the image and the results
+    QMutex _mutex;
+    //! Set to nonzero to cancel the export
+    QAtomicInt _cancel;
+    //! Index of the next tile to draw and number of tiles drawn, shared by the workers
+    QAtomicInt _nextTile, _doneTiles;
+
+    RenderView _view;
+    QString _document;
+    QImage *_image;
+    QRect _area;
+    //! Number of tile columns and rows of the part
+    int _columns, _rows;
+
+    bool _complete;
+    QString _recursionFunction;
+};
+
+#endif // _QMPLOT_EXPORTER_H
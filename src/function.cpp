@@ -9,8 +9,13 @@
 
 
 #include "function.h"
+#include "polyline.h"
+#include "implicit.h"
+#include "parallel.h"
 
 #include <QtXml>
+#include <QThreadStorage>
+#include <QSet>
 #include <cmath>
 using namespace std;
 
@@ -72,7 +77,11 @@ void saveDoubleProperty(QDomDocument &document, QDomElement &element,
 {
   QDomElement propertyElement = document.createElement(name);
   element.appendChild(propertyElement);
-  QDomText text = document.createTextNode(QString().setNum(value));
+  // As many digits as needed to read back the same value
+  QString string = QString().setNum(value, 'g', 15);
+  if (string.toDouble() != value)
+    string.setNum(value, 'g', 17);
+  QDomText text = document.createTextNode(string);
   propertyElement.appendChild(text);
 }
 
@@ -107,16 +116,25 @@ static const QColor COLOR_WHEEL[] = {
 static const int COLOR_WHEEL_SIZE = sizeof COLOR_WHEEL / sizeof *COLOR_WHEEL;
 static int COLOR_WHEEL_INDEX = 0;
 
-Function::Function(FunctionType vType) : _type(vType)
+/* Returns the next standard color; used only with the main FunctionDB, so that
+  copies made by other threads don't change the colors of new functions */
+static QColor nextWheelColor()
 {
-  _enabled = true;
-  _name = QString("noname");
-  _width = 1.0;
-  _color = COLOR_WHEEL[COLOR_WHEEL_INDEX];
+  QColor color = COLOR_WHEEL[COLOR_WHEEL_INDEX];
   if (++COLOR_WHEEL_INDEX >= COLOR_WHEEL_SIZE)
   {
     COLOR_WHEEL_INDEX = 0;
   }
+  return color;
+}
+
+Function::Function(FunctionType vType) : _type(vType)
+{
+  _enabled = true;
+  _name = QString("noname");
+  _width = 1.0;
+  _color = Qt::black;
+  _revision = _definitionRevision = 0;
 }
 
 bool Function::setName(const QString &vName)
@@ -137,6 +155,8 @@ bool Function::readProperties(const QDomElement &element)
   if (nameElement.isNull()) return false;
   if (!setName(nameElement.text())) return false;
 
+  _enabled = true;
+  readBoolProperty(element, "enabled", _enabled);
   readDoubleProperty(element, "width", _width);
 
   QDomElement colorElement = element.firstChildElement("color");
@@ -158,6 +178,7 @@ void Function::saveProperties(QDomDocument &document, QDomElement &element)
   QDomText nameText = document.createTextNode(_name);
   nameElement.appendChild(nameText);
 
+  saveBoolProperty(document, element, "enabled", _enabled);
   saveDoubleProperty(document, element, "width", _width);
 
   QDomElement colorElement = document.createElement("color");
@@ -167,10 +188,25 @@ void Function::saveProperties(QDomDocument &document, QDomElement &element)
   saveIntProperty(document, colorElement, "b", _color.blue());
 }
 
+//! Appends the names of the functions called in \a formula to \a names, without repeating them
+static void appendCalledFunctions(const TreeParser &formula, QStringList &names)
+{
+  vector<string> list = formula.externalFunctionsInExpression();
+  for (unsigned int i = 0; i < list.size(); ++i)
+  {
+    QString name = QString::fromStdString(list.at(i));
+    if (!names.contains(name))
+      names.append(name);
+  }
+}
+
 
 // -------- CartesianFunction --------
 
 
+// Step (in pixels) of the coarse grid on which cartesian functions are sampled first
+const double CARTESIAN_COARSE_STEP = 8.0;
+
 CartesianFunction::CartesianFunction(const QString &vName, CartesianType vSubtype)
     : Function(FT_Cartesian)
 {
@@ -179,6 +215,7 @@ CartesianFunction::CartesianFunction(const QString &vName, CartesianType vSubtyp
   _formula.setExpression("0");
   _minF = _maxF = false;
   _min = _max = 0.0;
+  _sampleCacheRevision = 0;
 }
 
 void CartesianFunction::reparse()
@@ -201,6 +238,22 @@ VerifyError CartesianFunction::check()
   return VE_NoError;
 }
 
+QStringList CartesianFunction::calledFunctions() const
+{
+  QStringList names;
+  appendCalledFunctions(_formula, names);
+  return names;
+}
+
+QStringList CartesianFunction::valueDefinition() const
+{
+  QStringList result;
+  result.append(QString::fromStdString(_formula.expression()));
+  // Calls give the value of x or of y
+  result.append(QString::number(_subtype));
+  return result;
+}
+
 bool CartesianFunction::readProperties(const QDomElement &element)
 {
   if (!Function::readProperties(element)) return false;
@@ -259,101 +312,144 @@ void CartesianFunction::saveProperties(QDomDocument &document, QDomElement &elem
   saveDoubleProperty(document, element, "max", _max);
 }
 
-void CartesianFunction::paint(QPainter &p, const FunctionPaintParams &fp)
+//! \class CartesianCurve Points of a cartesian function for CurveSampler
+/** The argument u is the distance in pixels along the X axis (for functions of X)
+  or along the Y axis, from the bottom (for functions of Y).
+  If \a vCache is given, values at aligned positions are taken from it or stored in it. */
+class CartesianCurve : public CurveSource
 {
-  if (!_enabled) return;
-  if (!_formula.status().ok()) return;
-
-  QPen functionPen = QPen();
-  functionPen.setJoinStyle(Qt::BevelJoin);
-  functionPen.setWidthF(_width);
-  functionPen.setColor(_color);
-  p.setPen(functionPen);
-
-  p.translate(fp.area.x(), fp.area.y());
-  p.setClipRect(0, 0, fp.area.width(), fp.area.height());
-
-  // We'll be drawing line segments, so we need these
-  double lastVal = 0.0;
-  bool hasLastVal = false;
-
-  if (_subtype == CT_XToY)
-  {
-    double xVal = 0.0;
-    _formula.setVariable("x", &xVal);
-
-    // Computed value
-    double val = 0.0;
-
-    // Iterate through all x values in the area
-    for (int x = 0; x < fp.area.width(); ++x)
+  public:
+    CartesianCurve(TreeParser &vFormula, CartesianType vSubtype, const FunctionPaintParams &vParams,
+                   SampleCache *vCache)
+      : _formula(vFormula), _subtype(vSubtype), _params(vParams), _cache(vCache)
     {
-      xVal = fp.xMin + x / fp.scale;
-      if ((_minF && (xVal < _min)) || (_maxF && (xVal > _max)))
-        continue;
+      _argument = 0.0;
+      _argMin = (_subtype == CT_XToY) ? _params.xMin : _params.yMin;
+      _formula.setVariable((_subtype == CT_XToY) ? "x" : "y", &_argument);
+    }
 
-      ComputeResult result = _formula.computeValue(val);
-      if (result.allOk())
-      {
-        // Convert val to pixel coordinates
-        val = fp.area.height() - (val - fp.yMin) * fp.scale;
+    ~CartesianCurve()
+    {
+      _formula.unsetVariable((_subtype == CT_XToY) ? "x" : "y");
+    }
 
-        if (fabs(val) > 32e3) continue;
+    bool point(double u, QPointF &result)
+    {
+      // Not cached, of course
+      if (_params.cancelled()) return false;
 
-        if (hasLastVal)
-          p.drawLine(QPointF(x - 1.0, lastVal), QPointF(x, val));
+      double val = 0.0;
+      bool valid = false;
 
-        lastVal = val;
-        hasLastVal = true;
+      qint64 key = 0;
+      if ((_cache != NULL) && SampleCache::key(u + _argMin * _params.scale, key))
+      {
+        if (!_cache->lookup(key, val, valid))
+        {
+          // Computed exactly at the aligned position, so that the result doesn't depend on panning
+          _argument = key / (SampleCache::RESOLUTION * _params.scale);
+          valid = _formula.computeValue(val).allOk();
+          _cache->insert(key, val, valid);
+        }
       }
       else
       {
-        hasLastVal = false;
+        _argument = _argMin + u / _params.scale;
+        valid = _formula.computeValue(val).allOk();
       }
-    }
-    _formula.unsetVariable("x");
-  }
-  else // _subtype == CT_YToX
-  {
-    double yVal = 0.0;
-    _formula.setVariable("y", &yVal);
 
-    double val = 0.0;
+      if (!valid) return false;
 
-    for (int y = 0; y < fp.area.height(); ++y)
-    {
-      yVal = fp.yMin + y / fp.scale;
-      if ((_minF && (yVal < _min)) || (_maxF && (yVal > _max)))
-        continue;
+      if (_subtype == CT_XToY)
+        result = QPointF(u, _params.area.height() - (val - _params.yMin) * _params.scale);
+      else
+        result = QPointF((val - _params.xMin) * _params.scale, _params.area.height() - u);
 
-      ComputeResult result = _formula.computeValue(val);
+      return true;
+    }
 
-      if (result.allOk())
-      {
-        val = (val - fp.xMin) * fp.scale;
+  private:
+    TreeParser &_formula;
+    CartesianType _subtype;
+    const FunctionPaintParams &_params;
+    SampleCache *_cache;
+    //! Minimum value of the argument in the area
+    double _argMin;
+    //! Value of the variable set on the parser
+    double _argument;
+};
 
-        if (fabs(val) > 32e3) continue;
+void CartesianFunction::paint(QPainter &p, const FunctionPaintParams &fp)
+{
+  if (!_enabled) return;
+  if (!_formula.status().ok()) return;
 
-        if (hasLastVal)
-          p.drawLine(QPointF(lastVal, fp.area.height() - y + 1.0),
-                     QPointF(val, fp.area.height() - y));
+  QPen functionPen = QPen();
+  functionPen.setJoinStyle(Qt::BevelJoin);
+  functionPen.setWidthF(_width);
+  functionPen.setColor(_color);
+  p.setPen(functionPen);
 
-        lastVal = val;
-        hasLastVal = true;
-      }
-      else
-      {
-        hasLastVal = false;
-      }
-    }
-    _formula.unsetVariable("y");
+  p.translate(fp.area.x(), fp.area.y());
+  p.setClipRect(0, 0, fp.area.width(), fp.area.height());
+
+  // Segments are batched into polylines and clipped to the area, with a margin for the pen
+  double margin = _width + 2.0;
+  PolylineBuilder polyline(p, QRectF(-margin, -margin, fp.area.width() + 2.0 * margin,
+                                     fp.area.height() + 2.0 * margin));
+  polyline.setTolerance(fp.tolerance);
+
+  /* Values don't depend on the domain, which only limits the sampled range,
+     so the cache has to be cleared only for another formula or scale,
+     or when the formulas of the functions it calls change. */
+  if (_sampleCacheRevision != _revision)
+  {
+    _sampleCache.clear();
+    _sampleCacheRevision = _revision;
   }
+  _sampleCache.prepare(fp.scale, _formula.revision(), _subtype);
+
+  // Range of the argument in pixels, from the grid points around the area, limited to the domain
+  double argMin = (_subtype == CT_XToY) ? fp.xMin : fp.yMin;
+  double length = (_subtype == CT_XToY) ? fp.area.width() : fp.area.height();
+  // The grid is aligned to world coordinates, so the samples stay the same when panning
+  // A draft takes only every coarseness-th column, without subdivision
+  double step = (fp.coarseness > 1) ? fp.coarseness : CARTESIAN_COARSE_STEP;
+  double gridOrigin = -fmod(argMin * fp.scale, step);
+  double uMin = gridOrigin - step;
+  double uMax = gridOrigin + (floor((length - gridOrigin) / step) + 1.0) * step;
+  if (_minF)
+    uMin = qMax(uMin, (_min - argMin) * fp.scale);
+  if (_maxF)
+    uMax = qMin(uMax, (_max - argMin) * fp.scale);
+
+  CartesianCurve curve(_formula, _subtype, fp, &_sampleCache);
+  CurveSampler sampler(curve, polyline);
+  if (fp.coarseness > 1)
+    sampler.setMaxDepth(0);
+  sampler.sample(uMin, uMax, step, gridOrigin);
+
+  // Keep what may be needed after panning by the size of the area
+  double origin = argMin * fp.scale * SampleCache::RESOLUTION;
+  double range = length * SampleCache::RESOLUTION;
+  _sampleCache.prune(static_cast<qint64>(origin - range), static_cast<qint64>(origin + 2.0 * range),
+                     4 * sampler.sampleCount() + 1024);
 }
 
 
 // -------- ParametricFunction --------
 
 
+// Limits of the length of segments of a parametric curve drawn with the adaptive step, in pixels
+const double PARAMETRIC_MIN_SEGMENT = 2.0;
+const double PARAMETRIC_MAX_SEGMENT = 4.0;
+// Ranges of the parameter with the image smaller than this (in pixels) are drawn as a single point
+const double PARAMETRIC_POINT_SIZE = 0.5;
+// Ranges of at most this many steps are sampled, longer ones are first checked and halved
+const double PARAMETRIC_LEAF_STEPS = 64.0;
+// Longer ranges of the parameter are split into chunks of at most this many steps sampled in parallel
+const double PARAMETRIC_CHUNK_STEPS = 1024.0;
+
 ParametricFunction::ParametricFunction(const QString &vName) : Function(FT_Parametric)
 {
   _name = vName;
@@ -362,6 +458,7 @@ ParametricFunction::ParametricFunction(const QString &vName) : Function(FT_Param
   _minParam = 0.0;
   _maxParam = 2.0 * M_PI;
   _paramStep = 0.05;
+  _adaptiveStep = true;
 }
 
 void ParametricFunction::reparse()
@@ -389,6 +486,22 @@ VerifyError ParametricFunction::check()
   return VE_NoError;
 }
 
+QStringList ParametricFunction::calledFunctions() const
+{
+  QStringList names;
+  appendCalledFunctions(_xFormula, names);
+  appendCalledFunctions(_yFormula, names);
+  return names;
+}
+
+QStringList ParametricFunction::valueDefinition() const
+{
+  QStringList result;
+  result.append(QString::fromStdString(_xFormula.expression()));
+  result.append(QString::fromStdString(_yFormula.expression()));
+  return result;
+}
+
 bool ParametricFunction::readProperties(const QDomElement &element)
 {
   if (!Function::readProperties(element)) return false;
@@ -405,6 +518,8 @@ bool ParametricFunction::readProperties(const QDomElement &element)
   readDoubleProperty(element, "min_param", _minParam);
   readDoubleProperty(element, "max_param", _maxParam);
   readDoubleProperty(element, "param_step", _paramStep);
+  _adaptiveStep = true;
+  readBoolProperty(element, "adaptive_step", _adaptiveStep);
 
   return true;
 }
@@ -428,11 +543,282 @@ void ParametricFunction::saveProperties(QDomDocument &document, QDomElement &ele
   saveDoubleProperty(document, element, "min_param", _minParam);
   saveDoubleProperty(document, element, "max_param", _maxParam);
   saveDoubleProperty(document, element, "param_step", _paramStep);
+  saveBoolProperty(document, element, "adaptive_step", _adaptiveStep);
 }
 
+//! \class ParametricCurve Points of a parametric function for CurveSampler
+/** The argument u is the parameter t. Both formulas are computed by one ExpressionProgram,
+  so that their common parts are computed once. */
+class ParametricCurve : public CurveSource
+{
+  public:
+    ParametricCurve(TreeParser &vXFormula, TreeParser &vYFormula, const FunctionPaintParams &vParams)
+      : _xFormula(vXFormula), _yFormula(vYFormula), _params(vParams)
+    {
+      _program.addExpression(_xFormula);
+      _program.addExpression(_yFormula);
+
+      // Constant curves don't use t
+      _unusedT = 0.0;
+      _t = _program.variable("t");
+      if (_t == NULL)
+        _t = &_unusedT;
+    }
+
+    bool point(double u, QPointF &result)
+    {
+      if (_params.cancelled()) return false;
+
+      *_t = u;
+      double values[2];
+      if (!_program.compute(values).allOk()) return false;
+
+      result = QPointF((values[0] - _params.xMin) * _params.scale,
+                       _params.area.height() - (values[1] - _params.yMin) * _params.scale);
+      return true;
+    }
+
+    //! Finds a rectangle (in pixels) containing the curve for t in [\a tMin, \a tMax]
+    /** Returns false if it can't be found, e.g. when the curve isn't defined everywhere there. */
+    bool bounds(double tMin, double tMax, QRectF &result)
+    {
+      if (_params.cancelled()) return false;
+
+      IntervalMap intervals;
+      intervals["t"] = Interval(tMin, tMax);
+
+      Interval xRange, yRange;
+      if (!_xFormula.computeInterval(xRange, intervals).allOk()) return false;
+      if (!_yFormula.computeInterval(yRange, intervals).allOk()) return false;
+
+      double left = (xRange.lower - _params.xMin) * _params.scale;
+      double right = (xRange.upper - _params.xMin) * _params.scale;
+      double top = _params.area.height() - (yRange.upper - _params.yMin) * _params.scale;
+      double bottom = _params.area.height() - (yRange.lower - _params.yMin) * _params.scale;
+      // Infinite bounds
+      if ((right - left) - (right - left) != 0.0) return false;
+      if ((bottom - top) - (bottom - top) != 0.0) return false;
+
+      result = QRectF(left, top, right - left, bottom - top);
+      return true;
+    }
+
+    inline bool cancelled() const
+    { return _params.cancelled(); }
+
+  private:
+    TreeParser &_xFormula, &_yFormula;
+    const FunctionPaintParams &_params;
+    ExpressionProgram _program;
+    //! Register of t in _program
+    NumType *_t;
+    double _unusedT;
+};
+
+//! \enum RangeImage How the curve for a range of the parameter is drawn
+enum RangeImage
+{
+  RI_Sampled, //!< It has to be sampled
+  RI_Hidden,  //!< It lies off the clipping area
+  RI_Point    //!< It is smaller than a fraction of a pixel
+};
+
+//! Checks whether the curve for t in [\a tMin, \a tMax] needs to be sampled
+/** Where it doesn't, \a point is set to the point drawn for RI_Point. */
+static RangeImage parameterRangeImage(ParametricCurve &curve, const QRectF &clipRect,
+                                      double tMin, double tMax, QPointF &point)
+{
+  QRectF box;
+  if (!curve.bounds(tMin, tMax, box)) return RI_Sampled;
+
+  if ((box.right() < clipRect.left()) || (box.left() > clipRect.right()) ||
+      (box.bottom() < clipRect.top()) || (box.top() > clipRect.bottom()))
+    return RI_Hidden;
+
+  if ((box.width() <= PARAMETRIC_POINT_SIZE) && (box.height() <= PARAMETRIC_POINT_SIZE))
+  {
+    point = box.center();
+    return RI_Point;
+  }
+
+  return RI_Sampled;
+}
+
+//! Draws the curve for t in [\a tMin, \a tMax], where tMin lies on the grid of \a step from \a tOrigin
+/** The range is halved as long as it is longer than PARAMETRIC_LEAF_STEPS steps. Ranges whose
+  image is proven to lie off the clipping area are skipped and those smaller than a fraction
+  of a pixel are drawn as a point, so neither is sampled. */
+static void sampleParameterRange(ParametricCurve &curve, CurveSampler &sampler, PolylineBuilder &polyline,
+                                 double tMin, double tMax, double step, double tOrigin)
+{
+  if (curve.cancelled()) return;
+
+  QPointF point;
+  RangeImage image = parameterRangeImage(curve, polyline.clipRect(), tMin, tMax, point);
+  if (image == RI_Hidden)
+  {
+    polyline.breakLine();
+    return;
+  }
+  if (image == RI_Point)
+  {
+    polyline.addPoint(point);
+    return;
+  }
+
+  double steps = floor((tMax - tMin) / step);
+  if (steps <= PARAMETRIC_LEAF_STEPS)
+  {
+    sampler.sample(tMin, tMax, step, tOrigin);
+    return;
+  }
+
+  double tMiddle = tMin + floor(0.5 * steps) * step;
+  sampleParameterRange(curve, sampler, polyline, tMin, tMiddle, step, tOrigin);
+  sampleParameterRange(curve, sampler, polyline, tMiddle, tMax, step, tOrigin);
+}
+
+//! Draws the curve for \a steps values of t from \a tMin on, with the fixed \a step
+static void sampleParameterSteps(ParametricCurve &curve, PolylineBuilder &polyline,
+                                 double tMin, int steps, double step)
+{
+  QPointF point;
+
+  double tVal = tMin;
+  for (int i = 0; i < steps; ++i, tVal += step)
+  {
+    if (curve.point(tVal, point))
+      polyline.addPoint(point);
+    else
+      polyline.breakLine();
+  }
+}
+
+//! \struct ParameterChunk A part of the parameter range of a parametric function sampled by one worker
+struct ParameterChunk
+{
+  //! The range with the adaptive step; with the fixed one, tMin is the first value of t
+  double tMin, tMax;
+  //! Number of values of t with the fixed step
+  int steps;
+};
+
+//! Splits [\a tMin, \a tMax] into chunks of at most PARAMETRIC_CHUNK_STEPS steps for sampleParameterRange()
+/** The range is halved at the same points as in sampleParameterRange() and ranges which are
+  not sampled there are not split further, so sampling the chunks one after another gives
+  exactly the same points as sampling the whole range. */
+static void splitParameterRange(ParametricCurve &curve, const QRectF &clipRect, double tMin, double tMax,
+                                double step, QVector<ParameterChunk> &chunks)
+{
+  QPointF point;
+  double steps = floor((tMax - tMin) / step);
+  if ((steps <= PARAMETRIC_CHUNK_STEPS) ||
+      (parameterRangeImage(curve, clipRect, tMin, tMax, point) != RI_Sampled))
+  {
+    ParameterChunk chunk;
+    chunk.tMin = tMin;
+    chunk.tMax = tMax;
+    chunk.steps = 0;
+    chunks.append(chunk);
+    return;
+  }
+
+  double tMiddle = tMin + floor(0.5 * steps) * step;
+  splitParameterRange(curve, clipRect, tMin, tMiddle, step, chunks);
+  splitParameterRange(curve, clipRect, tMiddle, tMax, step, chunks);
+}
+
+//! Splits the values of t from \a tMin by \a step while less than \a tMax into chunks for sampleParameterSteps()
+/** The values are accumulated as in a single loop, so that they are exactly the same. */
+static void splitParameterSteps(double tMin, double tMax, double step, QVector<ParameterChunk> &chunks)
+{
+  int chunkSteps = static_cast<int>(PARAMETRIC_CHUNK_STEPS);
+  for (double tVal = tMin; tVal < tMax; tVal += step)
+  {
+    if ((chunks.isEmpty()) || (chunks.last().steps == chunkSteps))
+    {
+      ParameterChunk chunk;
+      chunk.tMin = tVal;
+      chunk.tMax = tMax;
+      chunk.steps = 0;
+      chunks.append(chunk);
+    }
+
+    ++chunks.last().steps;
+  }
+}
+
+//! \class ParametricChunks Samples the chunks of the parameter range in parallel
+/** Each worker computes the formulas with its own ParametricCurve and records the points of
+  a chunk in its own PolylineBuilder. The chunks are then drawn in order, so the curve is joined
+  and broken exactly where it would be if it was sampled in one go. */
+class ParametricChunks : public ParallelTask
+{
+  public:
+    ParametricChunks(TreeParser &vXFormula, TreeParser &vYFormula, const FunctionPaintParams &vParams,
+                     const QVector<ParameterChunk> &vChunks, bool vAdaptive, double vStep, double vTOrigin)
+      : _xFormula(vXFormula), _yFormula(vYFormula), _params(vParams), _chunks(vChunks)
+    {
+      _adaptive = vAdaptive;
+      _step = vStep;
+      _tOrigin = vTOrigin;
+    }
+
+    //! Samples the chunks and adds their points to \a polyline
+    void draw(PolylineBuilder &polyline)
+    {
+      int workers = parallelWorkerCount(_chunks.size());
+      for (int w = 0; w < workers; ++w)
+        _curves.append(new ParametricCurve(_xFormula, _yFormula, _params));
+      for (int c = 0; c < _chunks.size(); ++c)
+        _points.append(new PolylineBuilder(polyline.clipRect()));
+
+      parallelFor(*this, _chunks.size(), workers);
+
+      for (int c = 0; c < _points.size(); ++c)
+        _points.at(c)->replay(polyline);
+
+      qDeleteAll(_points);
+      _points.clear();
+      qDeleteAll(_curves);
+      _curves.clear();
+    }
+
+    void run(int index, int worker)
+    {
+      ParametricCurve &curve = *_curves.at(worker);
+      PolylineBuilder &points = *_points.at(index);
+      const ParameterChunk &chunk = _chunks.at(index);
+
+      if (!_adaptive)
+      {
+        sampleParameterSteps(curve, points, chunk.tMin, chunk.steps, _step);
+        return;
+      }
+
+      CurveSampler sampler(curve, points);
+      sampler.setSegmentLimits(PARAMETRIC_MIN_SEGMENT, PARAMETRIC_MAX_SEGMENT);
+      if (_params.coarseness > 1)
+        sampler.setMaxDepth(0);
+
+      sampleParameterRange(curve, sampler, points, chunk.tMin, chunk.tMax, _step, _tOrigin);
+    }
+
+  private:
+    TreeParser &_xFormula, &_yFormula;
+    const FunctionPaintParams &_params;
+    const QVector<ParameterChunk> &_chunks;
+    bool _adaptive;
+    double _step, _tOrigin;
+    //! Curves of the workers
+    QVector<ParametricCurve*> _curves;
+    //! Points recorded for each chunk
+    QVector<PolylineBuilder*> _points;
+};
+
 void ParametricFunction::paint(QPainter &p, const FunctionPaintParams &fp)
 {
-  if ((!_enabled) || (_minParam >= _maxParam)) return;
+  if ((!_enabled) || (_minParam >= _maxParam) || (_paramStep <= 0.0)) return;
   if (!_xFormula.status().ok()) return;
   if (!_yFormula.status().ok()) return;
 
@@ -445,40 +831,56 @@ void ParametricFunction::paint(QPainter &p, const FunctionPaintParams &fp)
   p.translate(fp.area.x(), fp.area.y());
   p.setClipRect(0, 0, fp.area.width(), fp.area.height());
 
-  double tVal = 0.0;
-  _xFormula.setVariable("t", &tVal);
-  _yFormula.setVariable("t", &tVal);
+  double margin = _width + 2.0;
+  PolylineBuilder polyline(p, QRectF(-margin, -margin, fp.area.width() + 2.0 * margin,
+                                     fp.area.height() + 2.0 * margin));
+  polyline.setTolerance(fp.tolerance);
+
+  // A draft takes proportionally larger steps
+  double step = _paramStep * qMax(1, fp.coarseness);
+
+  ParametricCurve curve(_xFormula, _yFormula, fp);
 
-  double xVal = 0.0, yVal = 0.0;
-  double lastXVal = 0.0;
-  double lastYVal = 0.0;
-  bool hasLastVal = false;
+  /* Long ranges are split into chunks sampled in parallel, unless there are external
+     functions, which can be computed only in this thread, or just one core */
+  QVector<ParameterChunk> chunks;
+  if (_xFormula.externalFunctionsInExpression().empty() && _yFormula.externalFunctionsInExpression().empty())
+  {
+    if (_adaptiveStep)
+      splitParameterRange(curve, polyline.clipRect(), _minParam, _maxParam, step, chunks);
+    else
+      splitParameterSteps(_minParam, _maxParam, step, chunks);
+  }
 
-  for (tVal = _minParam; tVal < _maxParam; tVal += _paramStep)
+  if ((chunks.size() > 1) && (parallelWorkerCount(chunks.size()) > 1))
   {
-    ComputeResult result1 = _xFormula.computeValue(xVal);
-    ComputeResult result2 = _yFormula.computeValue(yVal);
+    ParametricChunks chunked(_xFormula, _yFormula, fp, chunks, _adaptiveStep, step, _minParam);
+    chunked.draw(polyline);
+    return;
+  }
 
-    if ((result1.allOk()) && (result2.allOk()))
-    {
-      yVal = fp.area.height() - (yVal - fp.yMin) * fp.scale;
-      xVal = (xVal - fp.xMin) * fp.scale;
+  if (_adaptiveStep)
+  {
+    /* The step is subdivided where the points are too far apart on the screen
+       or the curve bends between them; a draft takes just the steps */
+    CurveSampler sampler(curve, polyline);
+    sampler.setSegmentLimits(PARAMETRIC_MIN_SEGMENT, PARAMETRIC_MAX_SEGMENT);
+    if (fp.coarseness > 1)
+      sampler.setMaxDepth(0);
+
+    sampleParameterRange(curve, sampler, polyline, _minParam, _maxParam, step, _minParam);
+    return;
+  }
 
-      if (hasLastVal)
-        p.drawLine(QPointF(lastXVal, lastYVal), QPointF(xVal, yVal));
+  QPointF point;
 
-      lastXVal = xVal;
-      lastYVal = yVal;
-      hasLastVal = true;
-    }
+  for (double tVal = _minParam; tVal < _maxParam; tVal += step)
+  {
+    if (curve.point(tVal, point))
+      polyline.addPoint(point);
     else
-    {
-      hasLastVal = false;
-    }
+      polyline.breakLine();
   }
-
-  _xFormula.unsetVariable("t");
-  _yFormula.unsetVariable("t");
 }
 
 
@@ -490,6 +892,8 @@ ImplicitFunction::ImplicitFunction(const QString &vName) : Function(FT_Implicit)
   _name = vName;
   _formula.setExpression("sin x + cos y");
   _drawAccuracy = 40.0;
+  _method = IM_Quadtree;
+  _shading = false;
 }
 
 void ImplicitFunction::reparse()
@@ -515,6 +919,18 @@ VerifyError ImplicitFunction::check()
   return VE_NoError;
 }
 
+QStringList ImplicitFunction::calledFunctions() const
+{
+  QStringList names;
+  appendCalledFunctions(_formula, names);
+  return names;
+}
+
+QStringList ImplicitFunction::valueDefinition() const
+{
+  return QStringList(QString::fromStdString(_formula.expression()));
+}
+
 bool ImplicitFunction::readProperties(const QDomElement &element)
 {
   if (!Function::readProperties(element)) return false;
@@ -527,6 +943,25 @@ bool ImplicitFunction::readProperties(const QDomElement &element)
 
   readDoubleProperty(element, "draw_accuracy", _drawAccuracy);
 
+  // Documents from before the quadtree method are drawn as they were
+  QDomElement methodElement = element.firstChildElement("method");
+  if (methodElement.isNull())
+    _method = IM_Scan;
+  else
+  {
+    if (methodElement.text() == "quadtree")
+      _method = IM_Quadtree;
+    else if (methodElement.text() == "raster")
+      _method = IM_Raster;
+    else if (methodElement.text() == "trace")
+      _method = IM_Trace;
+    else
+      _method = IM_Scan;
+  }
+
+  _shading = false;
+  readBoolProperty(element, "shading", _shading);
+
   return true;
 }
 
@@ -541,8 +976,114 @@ void ImplicitFunction::saveProperties(QDomDocument &document, QDomElement &eleme
   formulaElement.appendChild(formulaText);
 
   saveDoubleProperty(document, element, "draw_accuracy", _drawAccuracy);
+
+  QDomElement methodElement = document.createElement("method");
+  element.appendChild(methodElement);
+  QString mText;
+  if (_method == IM_Quadtree)
+    mText = "quadtree";
+  else if (_method == IM_Raster)
+    mText = "raster";
+  else if (_method == IM_Trace)
+    mText = "trace";
+  else
+    mText = "scan";
+
+  QDomText methodText = document.createTextNode(mText);
+  methodElement.appendChild(methodText);
+
+  saveBoolProperty(document, element, "shading", _shading);
 }
 
+//! \class ImplicitValues Values of an implicit function for the implicit engines
+class ImplicitValues : public ImplicitSource
+{
+  public:
+    ImplicitValues(TreeParser &vFormula, const FunctionPaintParams &vParams)
+      : _formula(vFormula), _params(vParams)
+    {
+      _ownedFormula = NULL;
+      init();
+    }
+
+    ~ImplicitValues()
+    {
+      _formula.unsetVariable("x");
+      _formula.unsetVariable("y");
+      delete _ownedFormula;
+    }
+
+    bool value(double x, double y, double &result)
+    {
+      if (_params.cancelled()) return false;
+
+      _x = _params.xMin + x / _params.scale;
+      _y = _params.yMin + (_params.area.height() - y) / _params.scale;
+      return _formula.computeValue(result).allOk();
+    }
+
+    bool mayContainZero(const QRectF &rect)
+    {
+      // Nothing more is drawn
+      if (_params.cancelled()) return false;
+
+      IntervalMap intervals;
+      intervals["x"] = Interval(_params.xMin + rect.left() / _params.scale,
+                                _params.xMin + rect.right() / _params.scale);
+      intervals["y"] = Interval(_params.yMin + (_params.area.height() - rect.bottom()) / _params.scale,
+                                _params.yMin + (_params.area.height() - rect.top()) / _params.scale);
+
+      Interval range;
+      ComputeResult result = _formula.computeInterval(range, intervals);
+
+      // Undefined in the whole rectangle
+      if ((result.mathError != ME_None) && (result.logicError == 0) && (!result.variableError))
+        return false;
+
+      if (!result.allOk())
+        return true;
+
+      return range.intersects(-_tolerance, _tolerance);
+    }
+
+    ImplicitSource* threadCopy()
+    {
+      // External functions are computed by FunctionDB, which can be used only from one thread
+      if (!_formula.externalFunctionsInExpression().empty())
+        return NULL;
+
+      // A shallow copy shares the token tree, but has its own variables
+      return new ImplicitValues(_formula.shallowCopy(), _params);
+    }
+
+  private:
+    //! Constructor of a thread copy, which takes the ownership of \a vFormula
+    ImplicitValues(TreeParser *vFormula, const FunctionPaintParams &vParams)
+      : _formula(*vFormula), _params(vParams)
+    {
+      _ownedFormula = vFormula;
+      init();
+    }
+
+    void init()
+    {
+      _x = _y = 0.0;
+      _formula.setVariable("x", &_x);
+      _formula.setVariable("y", &_y);
+      // As in the column scan
+      _tolerance = 0.5 / _params.scale;
+    }
+
+    TreeParser &_formula;
+    //! The formula if it is a copy made by threadCopy(), else NULL
+    TreeParser *_ownedFormula;
+    const FunctionPaintParams &_params;
+    //! Values of the variables set on the parser
+    double _x, _y;
+    //! Values in [-_tolerance, _tolerance] are treated like zero
+    double _tolerance;
+};
+
 void ImplicitFunction::paint(QPainter &p, const FunctionPaintParams &fp)
 {
   if (!_enabled) return;
@@ -557,133 +1098,136 @@ void ImplicitFunction::paint(QPainter &p, const FunctionPaintParams &fp)
   p.translate(fp.area.x(), fp.area.y());
   p.setClipRect(0, 0, fp.area.width(), fp.area.height());
 
-  double xVal = 0.0;
-  _formula.setVariable("x", &xVal);
-  double yVal = 0.0;
-  _formula.setVariable("y", &yVal);
+  // The region goes below the curve; the raster method draws both at once
+  if ((_method == IM_Raster) || _shading)
+    paintRaster(p, fp, _method == IM_Raster, _shading);
 
-  /* The minimum "resolving" value
-     Values in range [-threshold, threshold] are treated like zero */
-  double threshold = 0.5 / fp.scale;
+  if (_method == IM_Quadtree)
+    paintQuadtree(p, fp);
+  else if (_method == IM_Scan)
+    paintScan(p, fp);
+  else if (_method == IM_Trace)
+    paintTrace(p, fp);
+}
 
-  /* The plot is drawn by searching for roots in lines along Y axis
-      in subsequent blocks of the length _drawAccuracy.
-     The roots are found by calculating approximate differential of the function
-      and jumping to the calculated values. */
+// Size of the smallest tiles culled before the column scan, in pixels
+const int SCAN_TILE_SIZE = 16;
 
-  for (int x = 0; x < fp.area.width(); ++x)
-  {
-    xVal = fp.xMin + x / fp.scale;
+void ImplicitFunction::paintScan(QPainter &p, const FunctionPaintParams &fp)
+{
+  // Only the tiles in which the formula may be zero are scanned
+  QVector<QRect> tiles;
+  ImplicitValues values(_formula, fp);
+  findCandidateTiles(values, QRect(0, 0, fp.area.width(), fp.area.height()), SCAN_TILE_SIZE, tiles);
 
-    double y = 0.0;
-    // Values below this are already plotted
-    double doneY = 0.0;
-    // Count of the number of jumps in current block
-    int repeats = 0;
-    while (y < fp.area.height())
-    {
-      yVal = fp.yMin + y / fp.scale;
+  // A draft scans only every coarseness-th column
+  QPolygonF points;
+  ColumnScan scan(values, _drawAccuracy, fp.scale);
+  scan.scan(tiles, fp.area.height(), qMax(1, fp.coarseness), points);
 
-      double val = 0.0;
-      ComputeResult result = _formula.computeValue(val);
-      if (!result.allOk())
-      {
-        y += 1.0;
-        continue;
-      }
-
-      if (fabs(val) <= threshold)
-      {
-        yVal = fp.area.height() - (yVal - fp.yMin) * fp.scale;
+  p.drawPoints(points);
+}
 
-        p.drawPoint(QPointF(x, yVal));
+// Side of the leaves of the quadtree in pixels
+const double QUADTREE_LEAF_SIZE = 2.0;
 
-        repeats = 0;
-        doneY = y + 1.0;
-        y += _drawAccuracy;
-        continue;
-      }
-
-      // Calculate differential for the current point
+void ImplicitFunction::paintQuadtree(QPainter &p, const FunctionPaintParams &fp)
+{
+  double margin = _width + 2.0;
+  PolylineBuilder polyline(p, QRectF(-margin, -margin, fp.area.width() + 2.0 * margin,
+                                     fp.area.height() + 2.0 * margin));
+  polyline.setTolerance(fp.tolerance);
+
+  ImplicitValues values(_formula, fp);
+  // A draft has proportionally larger leaves
+  QuadtreeContour contour(values, QUADTREE_LEAF_SIZE * qMax(1, fp.coarseness));
+  contour.trace(fp.area.width(), fp.area.height(), polyline);
+}
 
-      double oldVal = val;
-      double oldYVal = yVal;
-      yVal += threshold;
+// The longest step of tracing in pixels
+const double TRACE_MAX_STEP = 4.0;
 
-      result = _formula.computeValue(val);
+void ImplicitFunction::paintTrace(QPainter &p, const FunctionPaintParams &fp)
+{
+  double margin = _width + 2.0;
+  PolylineBuilder polyline(p, QRectF(-margin, -margin, fp.area.width() + 2.0 * margin,
+                                     fp.area.height() + 2.0 * margin));
+  polyline.setTolerance(fp.tolerance);
+
+  ImplicitValues values(_formula, fp);
+  // A draft takes proportionally longer steps
+  CurveTracer tracer(values, TRACE_MAX_STEP * qMax(1, fp.coarseness));
+  tracer.trace(fp.area.width(), fp.area.height(), polyline);
+}
 
-      if (!result.allOk())
-      {
-        y += 1.0;
-        continue;
-      }
+// Opacity of the shaded region (0 - 255)
+const int SHADING_ALPHA = 64;
 
-      double diff = (val - oldVal) / threshold;
-      double newYVal = oldYVal - oldVal / diff;
-      double newY = (newYVal - fp.yMin) * fp.scale;
+void ImplicitFunction::paintRaster(QPainter &p, const FunctionPaintParams &fp, bool curve, bool region)
+{
+  // A draft has proportionally larger pixels
+  int pixelSize = qMax(1, fp.coarseness);
+  QImage image((fp.area.width() + pixelSize - 1) / pixelSize, (fp.area.height() + pixelSize - 1) / pixelSize,
+               QImage::Format_ARGB32_Premultiplied);
+  if (image.isNull()) return;
+  image.fill(0);
 
-      // Don't go back below the done values
-      if (newY < doneY)
-      {
-        repeats = 0;
-        y += _drawAccuracy;
-        doneY = y + 1.0;
-        continue;
-      }
+  QColor regionColor = _color;
+  regionColor.setAlpha(SHADING_ALPHA);
 
-      // Don't go back more than _drawAccuracy
-      if (y - newY > _drawAccuracy)
-      {
-        repeats = 0;
-        doneY = y + 1.0;
-        y += _drawAccuracy;
-        continue;
-      }
+  ImplicitValues values(_formula, fp);
+  SignRaster raster(values, pixelSize);
+  raster.render(image, curve, qPremultiply(_color.rgba()), region, qPremultiply(regionColor.rgba()));
 
-      // Don't go forward more than _drawAccuracy
-      if (newY - y > _drawAccuracy)
-      {
-        repeats = 0;
-        y += _drawAccuracy;
-        continue;
-      }
+  p.drawImage(QRectF(0, 0, image.width() * pixelSize, image.height() * pixelSize), image);
+}
 
-      // Abandon the search in current block if there were more than 5 jumps
-      if (++repeats > 5)
-      {
-        repeats = 0;
-        y += _drawAccuracy;
-        doneY = y + 1.0;
-        continue;
-      }
 
-      y = newY;
-    }
-  }
+// -------- FunctionDB --------
 
-  _formula.unsetVariable("x");
-  _formula.unsetVariable("y");
-}
 
+//! \struct ThreadFunctionDB The instance of FunctionDB of a thread, kept in QThreadStorage
+struct ThreadFunctionDB
+{
+  ThreadFunctionDB() : instance(NULL) {}
 
-// -------- FunctionDB --------
+  FunctionDB *instance;
+};
 
+// Instances of the threads which have their own
+static QThreadStorage<ThreadFunctionDB> threadInstances;
 
-FunctionDB::FunctionDB()
+/* The instance of a thread must be deleted by the same thread,
+  because it is removed from the storage of the current one. */
+FunctionDB::FunctionDB(bool vThreadInstance)
 {
-  Q_ASSERT(_instance == NULL);
-  _instance = this;
+  _threadInstance = vThreadInstance;
+  if (_threadInstance)
+  {
+    Q_ASSERT(threadInstances.localData().instance == NULL);
+    threadInstances.localData().instance = this;
+  }
+  else
+  {
+    Q_ASSERT(_instance == NULL);
+    _instance = this;
+
+    // Set callbacks for recursive functions; they use the instance of the calling thread
+    TreeParser::setIsFunction(isFunction);
+    TreeParser::setGetFunctionValue(getFunctionValue);
+  }
   _verifyError = VE_NoError;
   _recursionError = false;
-
-  // Set callbacks for recursive functions
-  TreeParser::setIsFunction(isFunction);
-  TreeParser::setGetFunctionValue(getFunctionValue);
+  _revision = 0;
 }
 
 FunctionDB::~FunctionDB()
 {
-  _instance = NULL;
+  if (_threadInstance)
+    threadInstances.localData().instance = NULL;
+  else
+    _instance = NULL;
+
   QMap<QString, Function*>::iterator it;
   for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
   {
@@ -693,6 +1237,18 @@ FunctionDB::~FunctionDB()
   _functionsMap.clear();
 }
 
+FunctionDB* FunctionDB::instance()
+{
+  if (threadInstances.hasLocalData())
+  {
+    FunctionDB *threadInstance = threadInstances.localData().instance;
+    if (threadInstance != NULL)
+      return threadInstance;
+  }
+
+  return _instance;
+}
+
 Function* FunctionDB::function(const QString &name)
 {
   Function *result = NULL;
@@ -772,7 +1328,11 @@ Function* FunctionDB::addFunction(FunctionType type, const QString &pName)
       break;
     }
   }
+  function->_color = nextWheelColor();
+  function->_revision = function->_definitionRevision = ++_revision;
   _functionsMap.insert(name, function);
+  // Formulas may call the new name
+  reparseFunctions();
   return function;
 }
 
@@ -785,12 +1345,18 @@ bool FunctionDB::removeFunction(const QString &name)
   delete function;
   function = NULL;
 
+  // Calls of the removed name become variables
+  reparseFunctions();
+
   return true;
 }
 
 void FunctionDB::clear()
 {
   _functionsMap.clear();
+  _dependencies.clear();
+  _callers.clear();
+  ++_revision;
 }
 
 bool FunctionDB::changeName(const QString &oldName, const QString &newName)
@@ -809,14 +1375,117 @@ bool FunctionDB::changeName(const QString &oldName, const QString &newName)
   _functionsMap.insert(newName, function);
   function = NULL;
 
+  reparseFunctions();
+
   return true;
 }
 
 void FunctionDB::reparseFunctions()
 {
+  _dependencies.clear();
+  _callers.clear();
+
   QMap<QString, Function*>::iterator it;
   for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
     it.value()->reparse();
+
+  // The graph is complete only once all are parsed
+  ++_revision;
+  for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
+  {
+    updateDependencies(it.value());
+    it.value()->_revision = _revision;
+    it.value()->_valueDefinition = it.value()->valueDefinition();
+  }
+}
+
+QString FunctionDB::calledFunction(const QString &name) const
+{
+  // The same order as in getFunctionValue()
+  if (_functionsMap.contains(name))
+    return name;
+
+  if (name.endsWith("_x") || name.endsWith("_y"))
+  {
+    QString secondName = name.left(name.size() - 2);
+    if (_functionsMap.contains(secondName) && (_functionsMap.value(secondName)->type() == FT_Parametric))
+      return secondName;
+  }
+
+  return QString();
+}
+
+void FunctionDB::updateDependencies(Function *function)
+{
+  QStringList called = function->calledFunctions();
+  QStringList names;
+  for (int i = 0; i < called.size(); ++i)
+  {
+    QString name = calledFunction(called.at(i));
+    if ((!name.isEmpty()) && (!names.contains(name)))
+      names.append(name);
+  }
+
+  QStringList oldNames = _dependencies.value(function->name());
+  for (int i = 0; i < oldNames.size(); ++i)
+    _callers[oldNames.at(i)].remove(function->name());
+  for (int i = 0; i < names.size(); ++i)
+    _callers[names.at(i)].insert(function->name());
+
+  _dependencies.insert(function->name(), names);
+}
+
+void FunctionDB::functionChanged(const QString &name)
+{
+  Function *function = _functionsMap.value(name);
+  if (function == NULL) return;
+
+  updateDependencies(function);
+
+  // Also verified again without a change, e.g. when the function is selected
+  QStringList valueDefinition = function->valueDefinition();
+  if (valueDefinition == function->_valueDefinition) return;
+  function->_valueDefinition = valueDefinition;
+
+  function->_revision = function->_definitionRevision = ++_revision;
+  QStringList dependents = dependentFunctions(name);
+  for (int i = 0; i < dependents.size(); ++i)
+    _functionsMap.value(dependents.at(i))->_revision = _revision;
+}
+
+void FunctionDB::propertiesChanged(const QString &name)
+{
+  Function *function = _functionsMap.value(name);
+  if (function == NULL) return;
+
+  function->_definitionRevision = ++_revision;
+}
+
+void FunctionDB::appearanceChanged()
+{
+  ++_revision;
+}
+
+QStringList FunctionDB::dependentFunctions(const QString &name) const
+{
+  // Breadth-first, so also recursive calls end
+  QStringList result;
+  QSet<QString> visited;
+  visited.insert(name);
+  QStringList queue(name);
+  while (!queue.isEmpty())
+  {
+    QSet<QString> callers = _callers.value(queue.takeFirst());
+    for (QSet<QString>::const_iterator it = callers.constBegin(); it != callers.constEnd(); ++it)
+    {
+      if (visited.contains(*it)) continue;
+      visited.insert(*it);
+      result.append(*it);
+      queue.append(*it);
+    }
+  }
+
+  return result;
 }
 
 void FunctionDB::disableFunctions()
@@ -824,12 +1493,12 @@ void FunctionDB::disableFunctions()
   QMap<QString, Function*>::iterator it;
   for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
     it.value()->enabled() = false;
+
+  ++_revision;
 }
 
 bool FunctionDB::verifyFunction(const QString &name)
 {
-  reparseFunctions();
-
   Function *function = NULL;
   if (_functionsMap.contains(name))
   {
@@ -841,6 +1510,11 @@ bool FunctionDB::verifyFunction(const QString &name)
     return false;
   }
 
+  /* Only this function is parsed again; functions calling it refer to it by name,
+     so their parse trees stay the same and only their values change. */
+  function->reparse();
+  functionChanged(name);
+
   _verifyError = function->check();
   function = NULL;
 
@@ -868,6 +1542,11 @@ bool FunctionDB::openFile(const QString &fileName)
   }
   file.close();
 
+  return readDocument(document);
+}
+
+bool FunctionDB::readDocument(const QDomDocument &document)
+{
   QDomElement documentElement = document.documentElement();
   if (documentElement.tagName() != "mplotdoc")
   {
@@ -885,61 +1564,139 @@ bool FunctionDB::openFile(const QString &fileName)
   QVector<Function*> readFunctions;
   for (int i = 0; i < functionList.size(); ++i)
   {
-    Function *function = NULL;
     QDomElement functionElement = functionList.at(i).toElement();
     if (functionElement.isNull()) continue;
 
-    QDomElement typeElement = functionElement.firstChildElement("type");
-    if (typeElement.isNull())
+    Function *function = readFunction(functionElement);
+    if (function != NULL)
+      readFunctions.append(function);
+  }
+
+  _functionsMap.clear();
+  for (int i = 0; i < readFunctions.size(); ++i)
+  {
+    _functionsMap.insert(readFunctions.at(i)->_name, readFunctions.at(i));
+  }
+
+  // Calls of other functions are found once all of them are read
+  reparseFunctions();
+
+  return true;
+}
+
+Function* FunctionDB::readFunction(const QDomElement &element)
+{
+  Function *function = NULL;
+
+  QDomElement typeElement = element.firstChildElement("type");
+  if (typeElement.isNull())
+  {
+    qDebug("No function type specified!");
+    return NULL;
+  }
+
+  QString text = typeElement.text();
+  if (text == "cartesian")
+  {
+    function = new CartesianFunction("f");
+  }
+  else if (text == "parametric")
+  {
+    function = new ParametricFunction("f");
+  }
+  else if (text == "implicit")
+  {
+    function = new ImplicitFunction("f");
+  }
+  else
+  {
+    qDebug("Invalid function type specified!");
+    return NULL;
+  }
+
+  if (function == NULL)
+  {
+    qDebug("Function creation failed!");
+    return NULL;
+  }
+
+  // Unless given in the document
+  if (!_threadInstance)
+    function->_color = nextWheelColor();
+
+  if (!function->readProperties(element))
+  {
+    qDebug("Some required properties could not be found!");
+    delete function;
+    function = NULL;
+    return NULL;
+  }
+
+  function->_revision = function->_definitionRevision = ++_revision;
+  return function;
+}
+
+void FunctionDB::updateFunctions(const QStringList &names, const QList<QDomElement> &elements)
+{
+  QSet<QString> nameSet;
+  for (int i = 0; i < names.size(); ++i)
+    nameSet.insert(names.at(i));
+
+  bool namesChanged = false;
+  QMap<QString, Function*>::iterator it = _functionsMap.begin();
+  while (it != _functionsMap.end())
+  {
+    if (nameSet.contains(it.key()))
     {
-      qDebug("No function type specified!");
+      ++it;
       continue;
     }
 
-    QString text = typeElement.text();
-    if (text == "cartesian")
-    {
-      function = new CartesianFunction("f");
-    }
-    else if (text == "parametric")
-    {
-      function = new ParametricFunction("f");
-    }
-    else if (text == "implicit")
-    {
-      function = new ImplicitFunction("f");
-    }
-    else
+    delete it.value();
+    it = _functionsMap.erase(it);
+    namesChanged = true;
+  }
+
+  QStringList replaced;
+  for (int i = 0; i < elements.size(); ++i)
+  {
+    Function *function = readFunction(elements.at(i));
+    if (function == NULL) continue;
+
+    if (!nameSet.contains(function->_name))
     {
-      qDebug("Invalid function type specified!");
+      delete function;
       continue;
     }
 
-    if (function == NULL)
+    Function *oldFunction = _functionsMap.value(function->_name);
+    if (oldFunction != NULL)
     {
-      qDebug("Function creation failed!");
-      continue;
+      // So that only a change of the values changes the functions which call it (see functionChanged())
+      function->_valueDefinition = oldFunction->_valueDefinition;
+      delete oldFunction;
+      replaced.append(function->_name);
     }
-
-    if (!function->readProperties(functionElement))
+    else
     {
-      qDebug("Some required properties could not be found!");
-      delete function;
-      function = NULL;
-      continue;
+      namesChanged = true;
     }
-
-    readFunctions.append(function);
-    function = NULL;
+    _functionsMap.insert(function->_name, function);
   }
 
-  _functionsMap.clear();
-  for (int i = 0; i < readFunctions.size(); ++i)
+  // Calls of the added or removed names are parsed differently in all formulas
+  if (namesChanged)
   {
-    _functionsMap.insert(readFunctions.at(i)->_name, readFunctions.at(i));
+    reparseFunctions();
+    return;
   }
 
-  return true;
+  // Calls of the replaced functions are by name, so the other formulas stay the same
+  for (int i = 0; i < replaced.size(); ++i)
+  {
+    _functionsMap.value(replaced.at(i))->reparse();
+    functionChanged(replaced.at(i));
+  }
 }
 
 bool FunctionDB::saveFile(const QString &fileName)
@@ -950,43 +1707,7 @@ bool FunctionDB::saveFile(const QString &fileName)
   }
 
   QDomDocument document;
-  QDomElement root = document.createElement("mplotdoc");
-  document.appendChild(root);
-
-  QMap<QString, Function*>::iterator it;
-  for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
-  {
-    QDomElement functionTag = document.createElement("function");
-    root.appendChild(functionTag);
-
-    QDomElement typeTag = document.createElement("type");
-    functionTag.appendChild(typeTag);
-    {
-      QString string;
-      switch (it.value()->type())
-      {
-        case FT_Cartesian:
-        {
-          string = "cartesian";
-          break;
-        }
-        case FT_Parametric:
-        {
-          string = "parametric";
-          break;
-        }
-        case FT_Implicit:
-        {
-          string = "implicit";
-          break;
-        }
-      }
-      QDomText text = document.createTextNode(string);
-      typeTag.appendChild(text);
-    }
-
-    it.value()->saveProperties(document, functionTag);
-  }
+  saveDocument(document);
 
   QByteArray output = document.toByteArray();
 
@@ -1005,6 +1726,51 @@ bool FunctionDB::saveFile(const QString &fileName)
   return true;
 }
 
+void FunctionDB::saveDocument(QDomDocument &document)
+{
+  QDomElement root = document.createElement("mplotdoc");
+  document.appendChild(root);
+
+  QMap<QString, Function*>::iterator it;
+  for (it = _functionsMap.begin(); it != _functionsMap.end(); ++it)
+    root.appendChild(saveFunction(document, it.value()));
+}
+
+QDomElement FunctionDB::saveFunction(QDomDocument &document, Function *function)
+{
+  QDomElement functionTag = document.createElement("function");
+
+  QDomElement typeTag = document.createElement("type");
+  functionTag.appendChild(typeTag);
+  {
+    QString string;
+    switch (function->type())
+    {
+      case FT_Cartesian:
+      {
+        string = "cartesian";
+        break;
+      }
+      case FT_Parametric:
+      {
+        string = "parametric";
+        break;
+      }
+      case FT_Implicit:
+      {
+        string = "implicit";
+        break;
+      }
+    }
+    QDomText text = document.createTextNode(string);
+    typeTag.appendChild(text);
+  }
+
+  function->saveProperties(document, functionTag);
+
+  return functionTag;
+}
+
 bool FunctionDB::isFunction(const std::string &n)
 {
   FunctionDB *i = FunctionDB::instance();
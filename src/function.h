@@ -11,13 +11,16 @@
 #define _QMPLOT_FUNCTION_H
 
 #include "treeparser.h"
+#include "sampler.h"
 
 #include <QString>
+#include <QStringList>
 #include <QColor>
 #include <QMap>
 #include <QPainter>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QAtomicInt>
 #include <string>
 
 
@@ -64,7 +67,12 @@ enum VerifyError
 struct FunctionPaintParams
 {
   FunctionPaintParams()
-  { xMin = yMin = 0.0; scale = 40.0; }
+  { xMin = yMin = 0.0; scale = 40.0; coarseness = 1; tolerance = 0.0; cancel = NULL; }
+
+  //! Returns true if the drawing is no longer needed
+  /** The functions then stop computing values as soon as they can; what they draw is discarded. */
+  inline bool cancelled() const
+  { return (cancel != NULL) && (cancel->load() != 0); }
 
   //! The area to draw
   QRect area;
@@ -72,6 +80,12 @@ struct FunctionPaintParams
   double xMin, yMin;
   //! Pixel scale
   double scale;
+  //! Resolution of a draft: functions are sampled every coarseness pixels; 1 for full resolution
+  int coarseness;
+  //! Distance in pixels by which curves may be simplified (see PolylineBuilder::setTolerance()); 0 to keep all points
+  double tolerance;
+  //! If given, set to nonzero (from another thread) to cancel the drawing
+  const QAtomicInt *cancel;
 };
 
 //! \class Function Abstract base class for functions
@@ -110,6 +124,18 @@ class Function
     inline QString name() const
     { return _name; }
 
+    //! Revision of the values: changes with the formulas of the function or of the functions it calls
+    /** Changed by FunctionDB::functionChanged(). Revisions are taken from FunctionDB::revision(),
+        so they are never the same for different values or definitions. */
+    inline unsigned long revision() const
+    { return _revision; }
+
+    //! Revision of the definition: changes with the saved properties, except the color and the enabled flag
+    /** Changed by FunctionDB::functionChanged() and FunctionDB::propertiesChanged(), but unlike
+        revision(), not by changes of the functions it calls. */
+    inline unsigned long definitionRevision() const
+    { return _definitionRevision; }
+
     //! Draw the function using given painter
     virtual void paint(QPainter &p, const FunctionPaintParams &fp) = 0;
 
@@ -119,6 +145,13 @@ class Function
     //! Check for variable errors
     virtual VerifyError check() = 0;
 
+    //! Returns the names of the functions called in the formula(s)
+    virtual QStringList calledFunctions() const = 0;
+
+    //! Returns what the values computed for calls of the function depend on
+    /** That is the formula(s) as they are saved and, for cartesian functions, the subtype. */
+    virtual QStringList valueDefinition() const = 0;
+
     //! Read properties from XML document
     virtual bool readProperties(const QDomElement &element);
     //! Save properties from XML document
@@ -135,6 +168,10 @@ class Function
     QColor _color;
     //! Width of plot line
     double _width;
+    //! See revision() and definitionRevision()
+    unsigned long _revision, _definitionRevision;
+    //! The valueDefinition() at the last change recorded by FunctionDB::functionChanged()
+    QStringList _valueDefinition;
 
   friend class FunctionDB;
 };
@@ -173,10 +210,18 @@ class CartesianFunction : public Function
 
     void paint(QPainter &p, const FunctionPaintParams &fp);
 
+    //! Drops the values cached by paint(), so the next one computes all of them
+    inline void clearSampleCache()
+    { _sampleCache.clear(); }
+
     void reparse();
 
     VerifyError check();
 
+    QStringList calledFunctions() const;
+
+    QStringList valueDefinition() const;
+
     bool readProperties(const QDomElement &element);
     void saveProperties(QDomDocument &document, QDomElement &element);
 
@@ -189,6 +234,10 @@ class CartesianFunction : public Function
     double _min, _max;
     //! Parsed formula
     TreeParser _formula;
+    //! Values computed in previous paint()s
+    SampleCache _sampleCache;
+    //! Revision of the function (see Function::revision()) the cached values are computed for
+    unsigned long _sampleCacheRevision;
 
   friend class FunctionDB;
 };
@@ -208,6 +257,8 @@ class ParametricFunction : public Function
     { return _maxParam; }
     inline double& paramStep()
     { return _paramStep; }
+    inline bool& adaptiveStep()
+    { return _adaptiveStep; }
     inline TreeParser& xFormula()
     { return _xFormula; }
     inline TreeParser& yFormula()
@@ -219,6 +270,10 @@ class ParametricFunction : public Function
 
     VerifyError check();
 
+    QStringList calledFunctions() const;
+
+    QStringList valueDefinition() const;
+
     bool readProperties(const QDomElement &element);
     void saveProperties(QDomDocument &document, QDomElement &element);
 
@@ -227,12 +282,27 @@ class ParametricFunction : public Function
     TreeParser _xFormula, _yFormula;
     //! Minimum and maximum values of parameter
     double _minParam, _maxParam;
-    //! Step of parameter in drawing
+    //! Step of parameter in drawing; the largest one if _adaptiveStep is set
     double _paramStep;
+    //! Whether the parameter is stepped adaptively, to the detail visible on the screen
+    bool _adaptiveStep;
 
   friend class FunctionDB;
 };
 
+//! \enum ImplicitMethod Describes the method of finding the curve of implicit function
+enum ImplicitMethod
+{
+  //! Newton's method along every column of pixels
+  IM_Scan,
+  //! Quadtree subdivision of the area with marching squares (see QuadtreeContour)
+  IM_Quadtree,
+  //! Sign changes at the corners of every pixel (see SignRaster)
+  IM_Raster,
+  //! Following the curve from seed points (see CurveTracer)
+  IM_Trace
+};
+
 //! \class ImplicitFunction An implicit function f(x, y) = ... = 0
 class ImplicitFunction : public Function
 {
@@ -247,6 +317,10 @@ class ImplicitFunction : public Function
     { return _formula; }
     inline double& drawAccuracy()
     { return _drawAccuracy; }
+    inline ImplicitMethod& method()
+    { return _method; }
+    inline bool& shading()
+    { return _shading; }
 
     void paint(QPainter &p, const FunctionPaintParams &fp);
 
@@ -254,6 +328,10 @@ class ImplicitFunction : public Function
 
     VerifyError check();
 
+    QStringList calledFunctions() const;
+
+    QStringList valueDefinition() const;
+
     bool readProperties(const QDomElement &element);
     void saveProperties(QDomDocument &document, QDomElement &element);
 
@@ -261,13 +339,29 @@ class ImplicitFunction : public Function
     //! Parsed formula
     TreeParser _formula;
     double _drawAccuracy;
+    //! Method of finding the curve
+    ImplicitMethod _method;
+    //! If true, the region where f(x, y) < 0 is shaded
+    bool _shading;
+
+    //! Paints with IM_Scan method
+    void paintScan(QPainter &p, const FunctionPaintParams &fp);
+    //! Paints with IM_Quadtree method
+    void paintQuadtree(QPainter &p, const FunctionPaintParams &fp);
+    //! Paints the curve with IM_Raster method and/or the shaded region
+    void paintRaster(QPainter &p, const FunctionPaintParams &fp, bool curve, bool region);
+    //! Paints with IM_Trace method
+    void paintTrace(QPainter &p, const FunctionPaintParams &fp);
 
   friend class FunctionDB;
 };
 
 //! \class FunctionDB The function database
 /** The class creates and stores Function objects.
-  Access is given only through pointers to the objects. */
+  Access is given only through pointers to the objects.
+
+  Functions can't be used by two threads at once, so a thread drawing them in the background
+  creates its own instance with copies of them (see readDocument()). */
 class FunctionDB
 {
   private:
@@ -276,17 +370,21 @@ class FunctionDB
     const FunctionDB& operator=(const FunctionDB &) { return *this; }
 
   public:
-    FunctionDB();
+    //! Creates the main instance or, if \a vThreadInstance is true, one for the current thread
+    explicit FunctionDB(bool vThreadInstance = false);
     ~FunctionDB();
 
-    //! Returns the only instance of the class
-    inline static FunctionDB* instance()
-    { return _instance; }
+    //! Returns the instance of the current thread, if it has one, or else the main instance
+    static FunctionDB* instance();
 
     //! Returns the error encountered after calling verifyFunctions()
     inline VerifyError verifyError() const
     { return _verifyError; }
 
+    //! Revision of the functions: changes with any change of them, including their colors and enabled flags
+    inline unsigned long revision() const
+    { return _revision; }
+
     //! Returns true, if recursion was detected
     inline bool recursionError() const
     { return _recursionError; }
@@ -319,12 +417,30 @@ class FunctionDB
     bool changeName(const QString &oldName, const QString &newName);
 
     //! Verifies the function of given name and returns true if no errors were found
+    /** The function is parsed again and recorded as changed (see functionChanged()). */
     bool verifyFunction(const QString &name);
 
+    //! Records a change of the formulas of the function \a name, or of the other properties of its values
+    /** Updates the functions it calls in the dependency graph and changes the revision
+        (see Function::revision()) of the function and of all functions which depend on it.
+        The revisions stay the same if Function::valueDefinition() is as at the last change. */
+    void functionChanged(const QString &name);
+
+    //! Records a change of the properties of the function \a name other than its formulas, color and enabled flag
+    /** E.g. of its width or domain; changes its definition revision (see Function::definitionRevision()). */
+    void propertiesChanged(const QString &name);
+    //! Records a change of the color or the enabled flag of a function
+    void appearanceChanged();
+
+    //! Returns the names of the functions which call the function \a name, directly or not
+    QStringList dependentFunctions(const QString &name) const;
+
     //! Disables all functions (sets their enabled flags to false)
     void disableFunctions();
 
-    //! Calls reparse() on all functions
+    //! Calls reparse() on all functions and rebuilds the dependency graph
+    /** Needed when a function is added, removed or renamed, because its name
+        is then parsed as a call in some formulas or as a variable. */
     void reparseFunctions();
 
     //! Read a QMPlot document (XML file)
@@ -332,11 +448,44 @@ class FunctionDB
     //! Save a QMPlot document
     bool saveFile(const QString &fileName);
 
+    //! Replaces the functions with those in \a document
+    /** Returns false if it contains no valid function list; the functions are then unchanged.
+        The functions are parsed again once all are read, so calls of functions defined later are found. */
+    bool readDocument(const QDomDocument &document);
+    //! Saves all functions to \a document
+    void saveDocument(QDomDocument &document);
+
+    //! Returns the element of \a document to which \a function is saved, as in saveDocument()
+    /** The element isn't added to \a document. */
+    QDomElement saveFunction(QDomDocument &document, Function *function);
+    //! Updates the functions to a document of which only the new and changed functions are given
+    /** \a names are the names of all functions of the document; the other functions are removed.
+        The functions saved in \a elements (see saveFunction()) replace those of the same name.
+        If no name was added or removed, only the replaced functions are parsed again and
+        recorded as changed (see functionChanged()), else all are parsed again. */
+    void updateFunctions(const QStringList &names, const QList<QDomElement> &elements);
+
+    //! Callback function for TreeParser
+    /** Returns true if the given name is a function */
+    static bool isFunction(const std::string &name);
+    //! Callback function for TreeParser
+    /** Computes the value of function given argument x and returns true if successful.
+        The function detects recursive calls and returns false. */
+    static bool getFunctionValue(const std::string &name, double x, double &value);
+
   private:
-    //! The pointer to the only instance of FunctionDB
+    //! The pointer to the main instance of FunctionDB
     static FunctionDB *_instance;
+    //! True if this is the instance of a thread
+    bool _threadInstance;
     //! Map of all functions (by unique names)
     QMap<QString, Function*> _functionsMap;
+    //! Dependency graph: names of the functions called directly by each function
+    QMap<QString, QStringList> _dependencies;
+    //! The dependency graph reversed: names of the functions which call each function directly
+    QMap<QString, QSet<QString> > _callers;
+    //! See revision()
+    unsigned long _revision;
     //! Verify error detected when calling verifyFunction()
     VerifyError _verifyError;
     //! True if recursion was detected (when calling getFunctionValue() )
@@ -345,13 +494,15 @@ class FunctionDB
     //! Generate an automatic name for new function
     QString genName();
 
-    //! Callback function for TreeParser
-    /** Returns true if the given name is a function */
-    static bool isFunction(const std::string &name);
-    //! Callback function for TreeParser
-    /** Computes the value of function given argument x and returns true if successful.
-        The function detects recursive calls and returns false. */
-    static bool getFunctionValue(const std::string &name, double x, double &value);
+    //! Creates the function saved in \a element (see saveFunction()); returns NULL if it isn't valid
+    /** The function isn't added to the functions. */
+    Function* readFunction(const QDomElement &element);
+
+    //! Returns the name of the function which a call of \a name computes, or an empty string if none
+    /** Components of parametric functions are called as name_x and name_y. */
+    QString calledFunction(const QString &name) const;
+    //! Sets the functions called by \a function in the dependency graph
+    void updateDependencies(Function *function);
 };
 
 #endif // _QMPLOT_FUNCTION_H
@@ -0,0 +1,1094 @@
+/* implicit.cpp - implements the engines which find and draw the curves of implicit functions.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "implicit.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+
+// Side of the cells of the coarse grid, in leaves (must be a power of 2)
+const int ROOT_SIZE = 16;
+/* A cell without a sign change is still subdivided if the smallest |f| at its samples
+  is below this fraction of the spread of the values, i.e. if f might reach zero in it. */
+const double NEAR_ZERO = 1.0;
+// Number of rows in the bands of SignRaster
+const int RASTER_BAND_ROWS = 16;
+
+// Newton's iterations from a root of the previous column in ColumnScan
+const int CONTINUE_ITERATIONS = 4;
+
+// CurveTracer (all distances in pixels)
+// Step of the central differences for the gradient
+const double GRADIENT_STEP = 0.25;
+// Newton's method stops when it moves the point less than this
+const double CORRECT_TOLERANCE = 0.05;
+const int CORRECT_ITERATIONS = 8;
+// The smallest step of tracing, before giving up or jumping over a crossing
+const double MIN_TRACE_STEP = 0.25;
+// Cosines of the largest turn of the tangent in one step, and of the turn below which the step grows
+const double MAX_TURN_COS = 0.985;  // 10 degrees
+const double GROW_TURN_COS = 0.9986; // 3 degrees
+const double STEP_GROWTH = 1.5;
+// Cosine of the largest turn of the tangent when jumping over a crossing of branches
+const double JUMP_TURN_COS = 0.9; // 25 degrees
+// Spacing of the seed grid, in the largest steps
+const double SEED_SPACING = 4.0;
+// Length of the interval to which the seeds are bisected before Newton's method
+const double SEED_ACCURACY = 0.5;
+// Seeds (and the start) nearer than this to a traced segment lie on it
+const double SEED_TOLERANCE = 1.0;
+// Limit of the steps of one branch
+const int MAX_TRACE_STEPS = 100000;
+
+
+//! Returns the key of the lattice point (\a i2, \a j2) given in halves of the lattice spacing
+static inline qint64 pointKey(int i2, int j2)
+{
+  return (static_cast<qint64>(i2) << 32) | static_cast<quint32>(j2);
+}
+
+//! Returns the key of the edge from the lattice point (\a i, \a j) to the right (\a vertical = 0) or down (1)
+static inline qint64 edgeKey(int i, int j, int vertical)
+{
+  return (static_cast<qint64>(i) << 33) | (static_cast<qint64>(static_cast<quint32>(j)) << 1) | vertical;
+}
+
+//! Returns the key of the cell (\a i, \a j) of a grid
+static inline qint64 cellKey(int i, int j)
+{
+  return pointKey(i, j);
+}
+
+//! Returns the scalar product of \a a and \a b
+static inline double dot(const QPointF &a, const QPointF &b)
+{
+  return a.x() * b.x() + a.y() * b.y();
+}
+
+//! Returns the distance from \a point to the segment from \a a to \a b
+static double distanceToSegment(const QPointF &point, const QPointF &a, const QPointF &b)
+{
+  QPointF ab = b - a;
+  double t = 0.0;
+  double length2 = dot(ab, ab);
+  if (length2 > 0.0)
+    t = qBound(0.0, dot(point - a, ab) / length2, 1.0);
+
+  QPointF d = point - (a + ab * t);
+  return sqrt(dot(d, d));
+}
+
+//! Returns true if \a value is not NaN
+static inline bool isValid(double value)
+{
+  return value == value;
+}
+
+
+WorkerSources::WorkerSources(ImplicitSource &vSource, int workers)
+{
+  _sources.append(&vSource);
+  for (int w = 1; w < workers; ++w)
+  {
+    ImplicitSource *copy = vSource.threadCopy();
+    if (copy == NULL) break;
+
+    _sources.append(copy);
+  }
+}
+
+WorkerSources::~WorkerSources()
+{
+  for (int w = 1; w < _sources.size(); ++w)
+    delete _sources[w];
+}
+
+
+void findCandidateTiles(ImplicitSource &source, const QRect &rect, int minSize, QVector<QRect> &tiles)
+{
+  if ((rect.width() <= 0) || (rect.height() <= 0)) return;
+  if (!source.mayContainZero(QRectF(rect))) return;
+
+  bool splitX = (rect.width() > minSize);
+  bool splitY = (rect.height() > minSize);
+  if ((!splitX) && (!splitY))
+  {
+    tiles.append(rect);
+    return;
+  }
+
+  int leftWidth = splitX ? rect.width() / 2 : rect.width();
+  int topHeight = splitY ? rect.height() / 2 : rect.height();
+
+  findCandidateTiles(source, QRect(rect.x(), rect.y(), leftWidth, topHeight), minSize, tiles);
+  if (splitX)
+    findCandidateTiles(source, QRect(rect.x() + leftWidth, rect.y(), rect.width() - leftWidth, topHeight),
+                       minSize, tiles);
+  if (splitY)
+    findCandidateTiles(source, QRect(rect.x(), rect.y() + topHeight, leftWidth, rect.height() - topHeight),
+                       minSize, tiles);
+  if (splitX && splitY)
+    findCandidateTiles(source, QRect(rect.x() + leftWidth, rect.y() + topHeight,
+                                     rect.width() - leftWidth, rect.height() - topHeight), minSize, tiles);
+}
+
+
+ColumnScan::ColumnScan(ImplicitSource &vSource, double vDrawAccuracy, double vScale)
+  : _source(vSource), _drawAccuracy(vDrawAccuracy)
+{
+  _threshold = 0.5 / vScale;
+  _sources = NULL;
+  _tiles = NULL;
+  _height = 0;
+  _columnStep = 1;
+}
+
+void ColumnScan::scan(const QVector<QRect> &tiles, int height, int columnStep, QPolygonF &points)
+{
+  if (tiles.isEmpty()) return;
+
+  // Long columns are needed to follow the roots from column to column
+  QVector<QRect> sorted;
+  mergeColumns(tiles, sorted, _stripStarts);
+  int strips = _stripStarts.size() - 1;
+
+  WorkerSources sources(_source, parallelWorkerCount(strips));
+  _sources = &sources;
+  _tiles = &sorted;
+  _height = height;
+  _columnStep = qMax(1, columnStep);
+  _tilePoints.clear();
+  _tilePoints.resize(strips);
+
+  parallelFor(*this, strips, sources.count());
+
+  for (int t = 0; t < _tilePoints.size(); ++t)
+    points += _tilePoints.at(t);
+
+  _tilePoints.clear();
+  _stripStarts.clear();
+  _sources = NULL;
+  _tiles = NULL;
+}
+
+//! Orders tiles by columns, from the left, and from the top in a column
+static bool columnOrder(const QRect &a, const QRect &b)
+{
+  if (a.x() != b.x()) return a.x() < b.x();
+  if (a.width() != b.width()) return a.width() < b.width();
+  return a.y() < b.y();
+}
+
+void ColumnScan::mergeColumns(const QVector<QRect> &tiles, QVector<QRect> &sorted, QVector<int> &stripStarts)
+{
+  sorted = tiles;
+  std::sort(sorted.begin(), sorted.end(), columnOrder);
+
+  stripStarts.clear();
+  for (int t = 0; t < sorted.size(); ++t)
+  {
+    const QRect &tile = sorted.at(t);
+    if ((t == 0) || (sorted.at(t - 1).x() != tile.x()) || (sorted.at(t - 1).width() != tile.width()) ||
+        (sorted.at(t - 1).y() + sorted.at(t - 1).height() != tile.y()))
+      stripStarts.append(t);
+  }
+  stripStarts.append(sorted.size());
+}
+
+void ColumnScan::run(int index, int worker)
+{
+  int first = _stripStarts.at(index), last = _stripStarts.at(index + 1) - 1;
+  const QRect &top = _tiles->at(first);
+  ImplicitSource &source = _sources->at(worker);
+  QPolygonF &points = _tilePoints[index];
+
+  // The scan goes upwards from the bottom of the area
+  double yStart = _height - (_tiles->at(last).y() + _tiles->at(last).height());
+  double yEnd = _height - top.y();
+
+  // Roots in the previous and the current column
+  QVector<double> previous, roots;
+
+  int xStart = ((top.x() + _columnStep - 1) / _columnStep) * _columnStep;
+  for (int x = xStart; x < top.x() + top.width(); x += _columnStep)
+  {
+    roots.clear();
+    // New roots can appear in pairs between the probes, so empty columns are always scanned
+    if (previous.isEmpty() || (!continueColumn(source, x, yStart, yEnd, previous, roots)))
+    {
+      // Each tile is scanned on its own, from the bottom one, as the search starts at its bottom
+      roots.clear();
+      for (int t = last; t >= first; --t)
+      {
+        const QRect &tile = _tiles->at(t);
+        scanColumn(source, x, _height - (tile.y() + tile.height()), _height - tile.y(), roots);
+      }
+    }
+
+    for (int k = 0; k < roots.size(); ++k)
+      points.append(QPointF(x, _height - roots.at(k)));
+
+    qSwap(previous, roots);
+  }
+}
+
+bool ColumnScan::continueColumn(ImplicitSource &source, int x, double yStart, double yEnd,
+                                const QVector<double> &previous, QVector<double> &roots) const
+{
+  /* The column is divided at the middles between the previous roots, so each part should
+     contain one root; the parts are probed at most _drawAccuracy apart. */
+  double lower = yStart;
+  double lowerValue = 0.0;
+  if (!source.value(x, _height - lower, lowerValue)) return false;
+
+  for (int k = 0; k < previous.size(); ++k)
+  {
+    double upper = (k < previous.size() - 1) ? 0.5 * (previous.at(k) + previous.at(k + 1)) : yEnd;
+
+    // Sign changes between the probes of the part
+    int changes = 0;
+    double probeValue = lowerValue;
+    int probes = qMax(1, static_cast<int>(ceil((upper - lower) / _drawAccuracy)));
+    for (int i = 1; i <= probes; ++i)
+    {
+      double probe = (i == probes) ? upper : lower + i * (upper - lower) / probes;
+      double value = 0.0;
+      if (!source.value(x, _height - probe, value)) return false;
+
+      if ((probeValue < 0.0) != (value < 0.0)) ++changes;
+      probeValue = value;
+    }
+
+    // The root has disappeared (or only touches zero) or another one has appeared: scan the column
+    if (changes != 1) return false;
+
+    // Newton's method from the previous root, as in scanColumn()
+    double y = previous.at(k);
+    bool found = false;
+    for (int i = 0; i < CONTINUE_ITERATIONS; ++i)
+    {
+      double val = 0.0, nextVal = 0.0;
+      if (!source.value(x, _height - y, val)) return false;
+
+      if (fabs(val) <= _threshold)
+      {
+        found = true;
+        break;
+      }
+
+      if (!source.value(x, _height - y - 0.5, nextVal)) return false;
+
+      y -= 0.5 * val / (nextVal - val);
+      if ((!(y >= lower)) || (!(y <= upper))) return false;
+    }
+
+    if (!found) return false;
+
+    roots.append(y);
+    lower = upper;
+    lowerValue = probeValue;
+  }
+
+  return true;
+}
+
+void ColumnScan::scanColumn(ImplicitSource &source, int x, double yStart, double yEnd, QVector<double> &roots) const
+{
+  double y = yStart;
+  // Values below this are already plotted
+  double doneY = yStart;
+  // Count of the number of jumps in current block
+  int repeats = 0;
+  while (y < yEnd)
+  {
+    double val = 0.0;
+    if (!source.value(x, _height - y, val))
+    {
+      y += 1.0;
+      continue;
+    }
+
+    if (fabs(val) <= _threshold)
+    {
+      roots.append(y);
+
+      repeats = 0;
+      doneY = y + 1.0;
+      y += _drawAccuracy;
+      continue;
+    }
+
+    // Calculate differential for the current point, half a pixel higher
+
+    double oldVal = val;
+    if (!source.value(x, _height - y - 0.5, val))
+    {
+      y += 1.0;
+      continue;
+    }
+
+    double newY = y - 0.5 * oldVal / (val - oldVal);
+
+    // Don't go back below the done values
+    if (newY < doneY)
+    {
+      repeats = 0;
+      y += _drawAccuracy;
+      doneY = y + 1.0;
+      continue;
+    }
+
+    // Don't go back more than _drawAccuracy
+    if (y - newY > _drawAccuracy)
+    {
+      repeats = 0;
+      doneY = y + 1.0;
+      y += _drawAccuracy;
+      continue;
+    }
+
+    /* Don't go forward more than _drawAccuracy; the search may come back
+       to a root it has jumped over, so this counts as a jump, too */
+    if (newY - y > _drawAccuracy)
+    {
+      if (++repeats > 5)
+      {
+        repeats = 0;
+        doneY = y + 1.0;
+      }
+      y += _drawAccuracy;
+      continue;
+    }
+
+    // Abandon the search in current block if there were more than 5 jumps
+    if (++repeats > 5)
+    {
+      repeats = 0;
+      y += _drawAccuracy;
+      doneY = y + 1.0;
+      continue;
+    }
+
+    y = newY;
+  }
+}
+
+
+SignRaster::SignRaster(ImplicitSource &vSource, double vPixelSize)
+  : _source(vSource), _pixelSize(vPixelSize)
+{
+  _sources = NULL;
+  _bits = NULL;
+  _bytesPerLine = _width = _height = 0;
+  _curve = _region = false;
+  _curveColor = _regionColor = 0;
+}
+
+void SignRaster::render(QImage &image, bool curve, QRgb curveColor, bool region, QRgb regionColor)
+{
+  if (image.isNull() || (_pixelSize <= 0.0) || ((!curve) && (!region))) return;
+  Q_ASSERT(image.format() == QImage::Format_ARGB32_Premultiplied);
+
+  _width = image.width();
+  _height = image.height();
+  // Detach the image here, so that the workers only write to it
+  _bits = image.bits();
+  _bytesPerLine = image.bytesPerLine();
+  _curve = curve;
+  _curveColor = curveColor;
+  _region = region;
+  _regionColor = regionColor;
+
+  int bands = (_height + RASTER_BAND_ROWS - 1) / RASTER_BAND_ROWS;
+  WorkerSources sources(_source, parallelWorkerCount(bands));
+  _sources = &sources;
+
+  parallelFor(*this, bands, sources.count());
+
+  _sources = NULL;
+  _bits = NULL;
+}
+
+//! Returns true if the values \a before, \a a, \a b, \a after grow towards the middle, as around a pole
+static inline bool isPole(double before, double a, double b, double after)
+{
+  // Around a zero they get smaller instead
+  return (fabs(a) > fabs(before)) && (fabs(b) > fabs(after));
+}
+
+//! Returns true if the sign changes between \a a and \a b at a zero of the function
+static inline bool isCrossing(double before, double a, double b, double after)
+{
+  return ((a < 0.0) != (b < 0.0)) && (!isPole(before, a, b, after));
+}
+
+void SignRaster::run(int index, int worker)
+{
+  ImplicitSource &source = _sources->at(worker);
+
+  int firstRow = index * RASTER_BAND_ROWS;
+  int lastRow = qMin(firstRow + RASTER_BAND_ROWS, _height);
+
+  /* The corners of the rows of pixels in the band, with one more row and column
+     on each side for the pole test on the edges */
+  int stride = _width + 3;
+  QVector<double> corners((lastRow - firstRow + 3) * stride);
+  for (int j = firstRow - 1; j <= lastRow + 1; ++j)
+    evaluateRow(source, j, corners.data() + (j - firstRow + 1) * stride);
+
+  for (int j = firstRow; j < lastRow; ++j)
+  {
+    QRgb *line = reinterpret_cast<QRgb*>(_bits + j * _bytesPerLine);
+    // Rows of corners above and below the pixels, and the ones outside them
+    const double *above = corners.constData() + (j - firstRow + 1) * stride + 1;
+    const double *below = above + stride;
+    const double *outAbove = above - stride;
+    const double *outBelow = below + stride;
+
+    for (int x = 0; x < _width; ++x)
+    {
+      double a = above[x], b = above[x + 1];
+      double c = below[x + 1], d = below[x];
+
+      // NaN is neither negative nor positive
+      int negative = (a < 0.0) + (b < 0.0) + (c < 0.0) + (d < 0.0);
+      int positive = (a >= 0.0) + (b >= 0.0) + (c >= 0.0) + (d >= 0.0);
+      if (negative + positive < 4) continue;
+
+      if (_region && (negative >= 2))
+        line[x] = _regionColor;
+
+      if (_curve && (negative > 0) && (positive > 0) &&
+          (isCrossing(above[x - 1], a, b, above[x + 2]) ||
+           isCrossing(outAbove[x + 1], b, c, outBelow[x + 1]) ||
+           isCrossing(below[x - 1], d, c, below[x + 2]) ||
+           isCrossing(outAbove[x], a, d, outBelow[x])))
+        line[x] = _curveColor;
+    }
+  }
+}
+
+void SignRaster::evaluateRow(ImplicitSource &source, int j, double *values) const
+{
+  double y = j * _pixelSize;
+  for (int x = -1; x <= _width + 1; ++x)
+  {
+    double result = 0.0;
+    if ((!source.value(x * _pixelSize, y, result)) || (result - result != 0.0))
+      result = numeric_limits<double>::quiet_NaN();
+
+    values[x + 1] = result;
+  }
+}
+
+
+CurveTracer::CurveTracer(ImplicitSource &vSource, double vMaxStep)
+  : _source(vSource), _maxStep(vMaxStep)
+{
+  _evaluationCount = 0;
+  _seedSpacing = 0.0;
+}
+
+void CurveTracer::trace(int width, int height, PolylineBuilder &polyline)
+{
+  _seeds.clear();
+  _seedCells.clear();
+  _evaluationCount = 0;
+
+  if ((width <= 0) || (height <= 0) || (_maxStep < MIN_TRACE_STEP)) return;
+
+  double margin = 2.0 * _maxStep;
+  _bounds = QRectF(-margin, -margin, width + 2.0 * margin, height + 2.0 * margin);
+  _seedSpacing = SEED_SPACING * _maxStep;
+
+  findSeeds(width, height);
+
+  QVector<QPointF> forward, backward;
+  for (int s = 0; s < _seeds.size(); ++s)
+  {
+    if (_seeds[s].used) continue;
+    _seeds[s].used = true;
+
+    QPointF start = _seeds[s].point;
+    QPointF direction;
+    if (!tangent(start, QPointF(), direction)) continue;
+
+    forward.clear();
+    backward.clear();
+    forward.append(start);
+
+    bool closed = false;
+    follow(start, direction, forward, closed);
+    if (!closed)
+      follow(start, -direction, backward, closed);
+
+    polyline.breakLine();
+    for (int k = backward.size() - 1; k >= 0; --k)
+      polyline.addPoint(backward[k]);
+    for (int k = 0; k < forward.size(); ++k)
+      polyline.addPoint(forward[k]);
+    polyline.breakLine();
+  }
+
+  _seeds.clear();
+  _seedCells.clear();
+}
+
+bool CurveTracer::value(const QPointF &point, double &result)
+{
+  ++_evaluationCount;
+  return _source.value(point.x(), point.y(), result) && (result - result == 0.0);
+}
+
+bool CurveTracer::gradient(const QPointF &point, QPointF &result)
+{
+  double left = 0.0, right = 0.0, up = 0.0, down = 0.0;
+  if ((!value(QPointF(point.x() - GRADIENT_STEP, point.y()), left)) ||
+      (!value(QPointF(point.x() + GRADIENT_STEP, point.y()), right)) ||
+      (!value(QPointF(point.x(), point.y() - GRADIENT_STEP), up)) ||
+      (!value(QPointF(point.x(), point.y() + GRADIENT_STEP), down)))
+    return false;
+
+  result = QPointF(right - left, down - up) / (2.0 * GRADIENT_STEP);
+  return true;
+}
+
+bool CurveTracer::correct(QPointF &point)
+{
+  for (int k = 0; k < CORRECT_ITERATIONS; ++k)
+  {
+    double f = 0.0;
+    QPointF g;
+    if ((!value(point, f)) || (!gradient(point, g))) return false;
+
+    double length2 = dot(g, g);
+    if (length2 <= 0.0) return false;
+
+    // Newton's step along the gradient
+    point -= g * (f / length2);
+
+    if (fabs(f) <= CORRECT_TOLERANCE * sqrt(length2))
+      return true;
+  }
+
+  return false;
+}
+
+bool CurveTracer::tangent(const QPointF &point, const QPointF &direction, QPointF &result)
+{
+  QPointF g;
+  if (!gradient(point, g)) return false;
+
+  double length = sqrt(dot(g, g));
+  if (length <= 0.0) return false;
+
+  result = QPointF(-g.y(), g.x()) / length;
+  if (dot(result, direction) < 0.0)
+    result = -result;
+
+  return true;
+}
+
+void CurveTracer::findSeeds(int width, int height)
+{
+  int columns = static_cast<int>(ceil(width / _seedSpacing));
+  int rows = static_cast<int>(ceil(height / _seedSpacing));
+
+  // Values at the nodes of the grid, NaN where undefined
+  QVector<double> values((columns + 1) * (rows + 1));
+  for (int j = 0; j <= rows; ++j)
+  {
+    for (int i = 0; i <= columns; ++i)
+    {
+      double result = 0.0;
+      if (!value(QPointF(i * _seedSpacing, j * _seedSpacing), result))
+        result = numeric_limits<double>::quiet_NaN();
+
+      values[j * (columns + 1) + i] = result;
+    }
+  }
+
+  for (int j = 0; j <= rows; ++j)
+  {
+    for (int i = 0; i <= columns; ++i)
+    {
+      QPointF node(i * _seedSpacing, j * _seedSpacing);
+      double f = values.at(j * (columns + 1) + i);
+      if (!isValid(f)) continue;
+
+      // The edges to the right and down
+      for (int vertical = 0; vertical < 2; ++vertical)
+      {
+        if ((vertical == 0) && (i == columns)) continue;
+        if ((vertical == 1) && (j == rows)) continue;
+
+        double g = vertical ? values.at((j + 1) * (columns + 1) + i) : values.at(j * (columns + 1) + i + 1);
+        if ((!isValid(g)) || ((f < 0.0) == (g < 0.0))) continue;
+
+        QPointF other = vertical ? QPointF(node.x(), node.y() + _seedSpacing) :
+                                   QPointF(node.x() + _seedSpacing, node.y());
+        Seed seed;
+        seed.used = false;
+        if (!findZero(node, f, other, g, seed.point)) continue;
+
+        _seedCells[cellKey(static_cast<int>(floor(seed.point.x() / _seedSpacing)),
+                           static_cast<int>(floor(seed.point.y() / _seedSpacing)))].append(_seeds.size());
+        _seeds.append(seed);
+      }
+    }
+  }
+}
+
+bool CurveTracer::findZero(QPointF a, double fa, QPointF b, double fb, QPointF &zero)
+{
+  double spread = qMax(fabs(fa), fabs(fb));
+
+  while (sqrt(dot(b - a, b - a)) > SEED_ACCURACY)
+  {
+    QPointF m = (a + b) * 0.5;
+    double fm = 0.0;
+    if (!value(m, fm)) return false;
+
+    if ((fm < 0.0) == (fa < 0.0))
+    {
+      a = m;
+      fa = fm;
+    }
+    else
+    {
+      b = m;
+      fb = fm;
+    }
+  }
+
+  // Towards a zero the values get smaller; towards a pole they grow
+  if (qMax(fabs(fa), fabs(fb)) > spread) return false;
+
+  zero = a + (b - a) * (fa / (fa - fb));
+  return correct(zero);
+}
+
+void CurveTracer::useSeeds(const QPointF &a, const QPointF &b)
+{
+  // A step is shorter than the spacing of the seeds, so the neighbouring cells are enough
+  QPointF middle = (a + b) * 0.5;
+  int ci = static_cast<int>(floor(middle.x() / _seedSpacing));
+  int cj = static_cast<int>(floor(middle.y() / _seedSpacing));
+  for (int j = cj - 1; j <= cj + 1; ++j)
+  {
+    for (int i = ci - 1; i <= ci + 1; ++i)
+    {
+      QHash<qint64, QVector<int> >::const_iterator it = _seedCells.constFind(cellKey(i, j));
+      if (it == _seedCells.constEnd()) continue;
+
+      const QVector<int> &indices = it.value();
+      for (int k = 0; k < indices.size(); ++k)
+      {
+        Seed &seed = _seeds[indices.at(k)];
+        if ((!seed.used) && (distanceToSegment(seed.point, a, b) <= SEED_TOLERANCE))
+          seed.used = true;
+      }
+    }
+  }
+}
+
+void CurveTracer::follow(const QPointF &start, const QPointF &direction, QVector<QPointF> &points, bool &closed)
+{
+  closed = false;
+
+  QPointF p = start;
+  QPointF t = direction;
+  double step = _maxStep;
+  double length = 0.0;
+
+  for (int count = 0; count < MAX_TRACE_STEPS; ++count)
+  {
+    // Predictor along the tangent, corrector onto the curve
+    QPointF q = p + t * step;
+    QPointF tq;
+    bool ok = correct(q) && tangent(q, t, tq);
+    if (ok)
+    {
+      double distance = sqrt(dot(q - p, q - p));
+      ok = (distance <= 2.0 * step) && (dot(t, tq) >= MAX_TURN_COS);
+    }
+
+    if (!ok)
+    {
+      // Too sharp a turn: try a shorter step
+      if (step > MIN_TRACE_STEP)
+      {
+        step = qMax(0.5 * step, MIN_TRACE_STEP);
+        continue;
+      }
+
+      // The gradient vanishes where branches cross: try to continue beyond the crossing
+      q = p + t * (2.0 * _maxStep);
+      if ((!correct(q)) || (!tangent(q, t, tq)) || (dot(t, tq) < JUMP_TURN_COS) ||
+          (sqrt(dot(q - p, q - p)) > 4.0 * _maxStep))
+        break;
+
+      step = _maxStep;
+    }
+
+    useSeeds(p, q);
+
+    // Back at the start: a closed loop
+    if ((length > 2.0 * _maxStep) && (distanceToSegment(start, p, q) <= SEED_TOLERANCE))
+    {
+      points.append(start);
+      closed = true;
+      break;
+    }
+
+    length += sqrt(dot(q - p, q - p));
+    points.append(q);
+
+    if (!_bounds.contains(q)) break;
+
+    if (dot(t, tq) >= GROW_TURN_COS)
+      step = qMin(STEP_GROWTH * step, _maxStep);
+
+    p = q;
+    t = tq;
+  }
+}
+
+
+QuadtreeContour::QuadtreeContour(ImplicitSource &vSource, double vLeafSize)
+  : _source(vSource), _leafSize(vLeafSize)
+{
+  _evaluationCount = 0;
+  _sources = NULL;
+  _columns = 0;
+}
+
+void QuadtreeContour::trace(int width, int height, PolylineBuilder &polyline)
+{
+  _bands.clear();
+  _segments.clear();
+  _edgeFirst.clear();
+  _edgeSecond.clear();
+  _evaluationCount = 0;
+
+  if ((width <= 0) || (height <= 0) || (_leafSize <= 0.0)) return;
+
+  _columns = static_cast<int>(ceil(width / _leafSize));
+  int rows = static_cast<int>(ceil(height / _leafSize));
+  int bands = (rows + ROOT_SIZE - 1) / ROOT_SIZE;
+
+  WorkerSources sources(_source, parallelWorkerCount(bands));
+  _sources = &sources;
+  _bands.resize(bands);
+
+  parallelFor(*this, bands, sources.count());
+
+  _sources = NULL;
+
+  stitch(polyline);
+  _bands.clear();
+}
+
+void QuadtreeContour::run(int index, int worker)
+{
+  Band &band = _bands[index];
+  band.source = &_sources->at(worker);
+  band.evaluationCount = 0;
+
+  for (int i = 0; i < _columns; i += ROOT_SIZE)
+    subdivide(band, i, index * ROOT_SIZE, ROOT_SIZE);
+
+  // Only the segments are needed from now on
+  band.values.clear();
+  band.source = NULL;
+}
+
+double QuadtreeContour::value(Band &band, int i2, int j2)
+{
+  qint64 key = pointKey(i2, j2);
+  QHash<qint64, double>::const_iterator it = band.values.constFind(key);
+  if (it != band.values.constEnd())
+    return it.value();
+
+  ++band.evaluationCount;
+
+  double result = 0.0;
+  if ((!band.source->value(0.5 * i2 * _leafSize, 0.5 * j2 * _leafSize, result)) ||
+      (result - result != 0.0))
+    result = numeric_limits<double>::quiet_NaN();
+
+  band.values.insert(key, result);
+  return result;
+}
+
+void QuadtreeContour::subdivide(Band &band, int i, int j, int size)
+{
+  if (size <= 1)
+  {
+    march(band, i, j);
+    return;
+  }
+
+  if (!band.source->mayContainZero(QRectF(i * _leafSize, j * _leafSize, size * _leafSize, size * _leafSize)))
+    return;
+
+  double v[5];
+  v[0] = value(band, 2 * i, 2 * j);
+  v[1] = value(band, 2 * (i + size), 2 * j);
+  v[2] = value(band, 2 * (i + size), 2 * (j + size));
+  v[3] = value(band, 2 * i, 2 * (j + size));
+  v[4] = value(band, 2 * i + size, 2 * j + size);
+
+  int valid = 0, positive = 0;
+  double minValue = 0.0, maxValue = 0.0, minAbs = 0.0;
+  for (int k = 0; k < 5; ++k)
+  {
+    if (!isValid(v[k])) continue;
+
+    if ((valid == 0) || (v[k] < minValue)) minValue = v[k];
+    if ((valid == 0) || (v[k] > maxValue)) maxValue = v[k];
+    if ((valid == 0) || (fabs(v[k]) < minAbs)) minAbs = fabs(v[k]);
+    if (v[k] >= 0.0) ++positive;
+    ++valid;
+  }
+
+  // Undefined in the whole cell
+  if (valid == 0) return;
+
+  bool split = (valid < 5) ||                           // the boundary of the domain
+               ((positive > 0) && (positive < valid)) || // a sign change
+               (minAbs <= NEAR_ZERO * (maxValue - minValue));
+
+  if (!split) return;
+
+  int half = size / 2;
+  subdivide(band, i, j, half);
+  subdivide(band, i + half, j, half);
+  subdivide(band, i, j + half, half);
+  subdivide(band, i + half, j + half, half);
+}
+
+void QuadtreeContour::march(Band &band, int i, int j)
+{
+  // Corners clockwise from the top left
+  double v[4];
+  v[0] = value(band, 2 * i, 2 * j);
+  v[1] = value(band, 2 * (i + 1), 2 * j);
+  v[2] = value(band, 2 * (i + 1), 2 * (j + 1));
+  v[3] = value(band, 2 * i, 2 * (j + 1));
+
+  int positive = 0;
+  for (int k = 0; k < 4; ++k)
+  {
+    if (!isValid(v[k])) return;
+    if (v[k] >= 0.0) ++positive;
+  }
+
+  if ((positive == 0) || (positive == 4)) return;
+
+  // Edges clockwise from the top; each from its corner with the lower lattice indices
+  const int edgeI[4] = { i, i + 1, i, i };
+  const int edgeJ[4] = { j, j, j + 1, j };
+  const int vertical[4] = { 0, 1, 0, 1 };
+  const int from[4] = { 0, 1, 3, 0 };
+  const int to[4] = { 1, 2, 2, 3 };
+
+  qint64 edges[4];
+  QPointF points[4];
+  bool crossed[4];
+  int crossings = 0;
+  for (int e = 0; e < 4; ++e)
+  {
+    edges[e] = edgeKey(edgeI[e], edgeJ[e], vertical[e]);
+    crossed[e] = ((v[from[e]] >= 0.0) != (v[to[e]] >= 0.0));
+    if (!crossed[e]) continue;
+
+    // A pole anywhere in the leaf: nothing to draw
+    if (!crossing(band, edgeI[e], edgeJ[e], vertical[e], v[from[e]], v[to[e]], points[e]))
+      return;
+    ++crossings;
+  }
+
+  if (crossings == 4)
+  {
+    double center = value(band, 2 * i + 1, 2 * j + 1);
+    if (!isValid(center)) return;
+
+    // Saddle: the centre decides which pair of opposite corners is connected
+    if ((center >= 0.0) == (v[0] >= 0.0))
+    {
+      addSegment(band, edges[0], points[0], edges[1], points[1]);
+      addSegment(band, edges[2], points[2], edges[3], points[3]);
+    }
+    else
+    {
+      addSegment(band, edges[3], points[3], edges[0], points[0]);
+      addSegment(band, edges[1], points[1], edges[2], points[2]);
+    }
+    return;
+  }
+
+  int first = -1;
+  for (int e = 0; e < 4; ++e)
+  {
+    if (!crossed[e]) continue;
+
+    if (first < 0)
+      first = e;
+    else
+      addSegment(band, edges[first], points[first], edges[e], points[e]);
+  }
+}
+
+bool QuadtreeContour::crossing(Band &band, int i, int j, int vertical, double a, double b, QPointF &point)
+{
+  double m = value(band, 2 * i + 1 - vertical, 2 * j + vertical);
+  if (!isValid(m)) return false;
+
+  /* Towards a zero, the values at the ends of the half with the sign change get smaller.
+     Towards a pole, the larger of them doesn't and the middle exceeds the smaller end. */
+  bool keepA = ((m >= 0.0) != (a >= 0.0));
+  double kept = keepA ? a : b;
+  if ((fabs(m) > qMin(fabs(a), fabs(b))) && (qMax(fabs(kept), fabs(m)) >= qMax(fabs(a), fabs(b))))
+    return false;
+
+  // Linear interpolation in the half with the sign change
+  double t = keepA ? 0.5 * a / (a - m) : 0.5 + 0.5 * m / (m - b);
+
+  if (vertical)
+    point = QPointF(i * _leafSize, (j + t) * _leafSize);
+  else
+    point = QPointF((i + t) * _leafSize, j * _leafSize);
+
+  return true;
+}
+
+void QuadtreeContour::addSegment(Band &band, qint64 edgeA, const QPointF &a, qint64 edgeB, const QPointF &b)
+{
+  Segment s;
+  s.startEdge = edgeA;
+  s.endEdge = edgeB;
+  s.start = a;
+  s.end = b;
+  s.used = false;
+
+  band.segments.append(s);
+}
+
+int QuadtreeContour::neighbour(qint64 edge, int segment) const
+{
+  int first = _edgeFirst.value(edge, -1);
+  if (first != segment)
+    return first;
+
+  return _edgeSecond.value(edge, -1);
+}
+
+void QuadtreeContour::stitch(PolylineBuilder &polyline)
+{
+  // Join the bands in their order; segments on the borders meet at the shared edges
+  for (int b = 0; b < _bands.size(); ++b)
+  {
+    _evaluationCount += _bands.at(b).evaluationCount;
+    _segments += _bands.at(b).segments;
+  }
+
+  for (int index = 0; index < _segments.size(); ++index)
+  {
+    qint64 edges[2] = { _segments.at(index).startEdge, _segments.at(index).endEdge };
+    for (int k = 0; k < 2; ++k)
+    {
+      if (_edgeFirst.contains(edges[k]))
+        _edgeSecond.insert(edges[k], index);
+      else
+        _edgeFirst.insert(edges[k], index);
+    }
+  }
+
+  QVector<QPointF> forward, backward;
+
+  for (int s = 0; s < _segments.size(); ++s)
+  {
+    if (_segments[s].used) continue;
+    _segments[s].used = true;
+
+    forward.clear();
+    backward.clear();
+    forward.append(_segments[s].start);
+    forward.append(_segments[s].end);
+
+    // Follow the curve from the end of the segment
+    int current = s;
+    qint64 edge = _segments[s].endEdge;
+    bool closed = false;
+    for (;;)
+    {
+      int next = neighbour(edge, current);
+      if (next < 0) break;
+      if (next == s)
+      {
+        closed = true;
+        break;
+      }
+      if (_segments[next].used) break;
+
+      Segment &n = _segments[next];
+      n.used = true;
+      if (n.startEdge == edge)
+      {
+        forward.append(n.end);
+        edge = n.endEdge;
+      }
+      else
+      {
+        forward.append(n.start);
+        edge = n.startEdge;
+      }
+      current = next;
+    }
+
+    // and from its start, unless it came back
+    if (closed)
+    {
+      forward.append(_segments[s].start);
+    }
+    else
+    {
+      current = s;
+      edge = _segments[s].startEdge;
+      for (;;)
+      {
+        int next = neighbour(edge, current);
+        if ((next < 0) || _segments[next].used) break;
+
+        Segment &n = _segments[next];
+        n.used = true;
+        if (n.startEdge == edge)
+        {
+          backward.append(n.end);
+          edge = n.endEdge;
+        }
+        else
+        {
+          backward.append(n.start);
+          edge = n.startEdge;
+        }
+        current = next;
+      }
+    }
+
+    polyline.breakLine();
+    for (int k = backward.size() - 1; k >= 0; --k)
+      polyline.addPoint(backward[k]);
+    for (int k = 0; k < forward.size(); ++k)
+      polyline.addPoint(forward[k]);
+    polyline.breakLine();
+  }
+}
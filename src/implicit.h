@@ -0,0 +1,313 @@
+/* implicit.h - defines the engines which find and draw the curves of implicit functions.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_IMPLICIT_H
+#define _QMPLOT_IMPLICIT_H
+
+#include "polyline.h"
+#include "parallel.h"
+
+#include <QHash>
+#include <QVector>
+#include <QPointF>
+#include <QPolygonF>
+#include <QRectF>
+#include <QRect>
+#include <QImage>
+
+
+//! \class ImplicitSource Abstract source of values of f(x, y) for the implicit engines
+/** Coordinates are in pixels of the painted area: x to the right, y downwards. */
+class ImplicitSource
+{
+  public:
+    virtual ~ImplicitSource() {}
+
+    //! Computes f at (\a x, \a y); returns false if it is not defined there
+    virtual bool value(double x, double y, double &result) = 0;
+
+    //! Returns false if f is certainly not zero (or is undefined) anywhere in \a rect
+    /** The default can't tell, so it returns true. */
+    virtual bool mayContainZero(const QRectF &)
+    { return true; }
+
+    //! Returns a new source of the same values which can be used in another thread
+    /** The caller deletes it. The default returns NULL, meaning that the source
+        can be used only from one thread, so the engines work serially. */
+    virtual ImplicitSource* threadCopy()
+    { return NULL; }
+};
+
+//! \class WorkerSources Sources for the workers of parallelFor(): the original and its thread copies
+class WorkerSources
+{
+  public:
+    //! Prepares sources for up to \a workers workers; just one if \a vSource can't be copied
+    WorkerSources(ImplicitSource &vSource, int workers);
+    //! Deletes the copies
+    ~WorkerSources();
+
+    //! Number of workers which can be used
+    inline int count() const
+    { return _sources.size(); }
+
+    inline ImplicitSource& at(int worker)
+    { return *_sources.at(worker); }
+
+  private:
+    //! The original first, then the copies
+    QVector<ImplicitSource*> _sources;
+};
+
+//! Appends to \a tiles the parts of \a rect in which f may be zero
+/** The rectangle is split into quarters recursively, down to tiles of \a minSize pixels.
+  Parts for which ImplicitSource::mayContainZero() is false are dropped, so no point
+  needs to be evaluated in them. */
+void findCandidateTiles(ImplicitSource &source, const QRect &rect, int minSize, QVector<QRect> &tiles);
+
+//! \class ColumnScan Finds points of the curve f(x, y) = 0 by searching along columns of pixels
+/** The roots are searched in subsequent blocks of the given length (drawing accuracy)
+  upwards from the bottom, by calculating an approximate differential of the function
+  and jumping to the estimated root (Newton's method).
+
+  Roots in neighbouring columns are close to each other, so after the first column of a strip
+  the search starts from the roots of the previous column. The column is only probed at
+  most the drawing accuracy apart to check that every root is still there and no new sign
+  change has appeared; otherwise it is scanned as above, tile by tile.
+
+  The tiles lying one above another are joined into strips, which are scanned in parallel
+  where the source can be copied for other threads. The points found in each strip are
+  kept apart and joined in the order of the strips, so the result is the same for any
+  number of threads. */
+class ColumnScan : private ParallelTask
+{
+  public:
+    //! Creates the scan with blocks of \a vDrawAccuracy pixels at \a vScale pixels per unit
+    ColumnScan(ImplicitSource &vSource, double vDrawAccuracy, double vScale);
+
+    //! Scans every \a columnStep-th column of \a tiles of the area \a height pixels high
+    /** Points found are appended to \a points. */
+    void scan(const QVector<QRect> &tiles, int height, int columnStep, QPolygonF &points);
+
+  private:
+    ImplicitSource &_source;
+    double _drawAccuracy;
+    //! Values in [-_threshold, _threshold] are treated like zero
+    double _threshold;
+
+    // State of the current scan()
+    WorkerSources *_sources;
+    const QVector<QRect> *_tiles;
+    int _height, _columnStep;
+    //! Indices of the first tiles of the strips in *_tiles, and the count of tiles at the end
+    QVector<int> _stripStarts;
+    //! Points found in each of the strips
+    QVector<QPolygonF> _tilePoints;
+
+    //! Sorts \a tiles into \a sorted by columns and finds the strips of the tiles lying one above another
+    /** The strip i consists of the tiles stripStarts[i] .. stripStarts[i + 1] - 1 of \a sorted, from the top. */
+    static void mergeColumns(const QVector<QRect> &tiles, QVector<QRect> &sorted, QVector<int> &stripStarts);
+    //! Scans the strip \a index with the source of \a worker
+    void run(int index, int worker);
+    //! Scans the column \a x from \a yStart to \a yEnd (measured from the bottom), appending the roots to \a roots
+    void scanColumn(ImplicitSource &source, int x, double yStart, double yEnd, QVector<double> &roots) const;
+    //! Finds the roots of the column \a x starting from the roots \a previous of the previous column
+    /** Returns false (and the column must be scanned) if the probes between the roots show
+      that a root has appeared or disappeared, or if Newton's method doesn't converge. */
+    bool continueColumn(ImplicitSource &source, int x, double yStart, double yEnd,
+                        const QVector<double> &previous, QVector<double> &roots) const;
+};
+
+//! \class SignRaster Finds the curve f(x, y) = 0 and the region f(x, y) < 0 pixel by pixel
+/** The function is evaluated at the corners of the pixels, a whole row of corners at a time.
+  A pixel belongs to the curve if the sign changes on one of its edges (a change at a pole,
+  where the values grow towards it from both sides, is ignored), and to the region if at
+  least two of its corners are negative. Each pixel costs one evaluation however many
+  branches of the curve there are, and the result is written straight into the scanlines
+  of an image; curves are one pixel wide.
+
+  Bands of rows are processed in parallel where the source can be copied for other
+  threads; each band writes only its own scanlines. */
+class SignRaster : private ParallelTask
+{
+  public:
+    //! Creates the raster with pixels of \a vPixelSize pixels of the source
+    SignRaster(ImplicitSource &vSource, double vPixelSize);
+
+    //! Paints the curve and/or the region on \a image, which gives the size of the raster
+    /** The image must be in QImage::Format_ARGB32_Premultiplied; the colors are premultiplied too.
+      Other pixels are left as they are. */
+    void render(QImage &image, bool curve, QRgb curveColor, bool region, QRgb regionColor);
+
+  private:
+    ImplicitSource &_source;
+    double _pixelSize;
+
+    // State of the current render()
+    WorkerSources *_sources;
+    uchar *_bits;
+    int _bytesPerLine, _width, _height;
+    bool _curve, _region;
+    QRgb _curveColor, _regionColor;
+
+    //! Renders the band \a index of rows with the source of \a worker
+    void run(int index, int worker);
+    //! Computes the values at the corners of the row \a j from the column -1 to _width + 1 into \a values
+    /** Undefined values are stored as NaN. */
+    void evaluateRow(ImplicitSource &source, int j, double *values) const;
+};
+
+//! \class CurveTracer Follows the curve f(x, y) = 0 from seed points along its tangent
+/** Seeds are found where the sign of f changes on the edges of a coarse grid. From each
+  seed the curve is followed in both directions: a step along the tangent (predictor) is
+  pulled back onto the curve by Newton's method along the gradient (corrector). The step
+  shrinks where the curve turns sharply and grows where it is straight, so the number of
+  evaluations grows with the length of the curve, not with the area.
+
+  A branch ends when it leaves the area, comes back to its start (a closed loop) or can't
+  be followed even with the smallest step. Where branches cross, the gradient vanishes;
+  the tracer then jumps over the crossing along the tangent and continues on the same
+  branch. Seeds passed by a traced branch are not used again. */
+class CurveTracer
+{
+  public:
+    //! Creates the tracer with steps of at most \a vMaxStep pixels
+    CurveTracer(ImplicitSource &vSource, double vMaxStep);
+
+    //! Finds the curve in the area of \a width x \a height pixels and draws it on \a polyline
+    void trace(int width, int height, PolylineBuilder &polyline);
+
+    //! Number of evaluations done by the last trace()
+    inline int evaluationCount() const
+    { return _evaluationCount; }
+
+  private:
+    //! \struct Seed A point of the curve where tracing can start
+    struct Seed
+    {
+      QPointF point;
+      bool used;
+    };
+
+    ImplicitSource &_source;
+    double _maxStep;
+    int _evaluationCount;
+
+    // State of the current trace()
+    //! The area with a margin; branches leaving it end
+    QRectF _bounds;
+    //! Spacing of the grid on which the seeds are searched
+    double _seedSpacing;
+    QVector<Seed> _seeds;
+    //! Indices of seeds in the cells of the grid
+    QHash<qint64, QVector<int> > _seedCells;
+
+    //! Computes f at \a point; returns false if it is not defined (or not finite) there
+    bool value(const QPointF &point, double &result);
+    //! Computes the gradient of f at \a point by central differences
+    bool gradient(const QPointF &point, QPointF &result);
+    //! Moves \a point onto the curve with Newton's method; returns false if it doesn't converge
+    bool correct(QPointF &point);
+    //! Returns the unit tangent at \a point, turned to agree with \a direction (if it's not null)
+    bool tangent(const QPointF &point, const QPointF &direction, QPointF &result);
+    //! Finds the seeds on the grid in the area of \a width x \a height pixels
+    void findSeeds(int width, int height);
+    //! Finds the zero between \a a and \a b with values \a fa and \a fb of different signs
+    /** Returns false if the sign changes at a pole rather than at a zero. */
+    bool findZero(QPointF a, double fa, QPointF b, double fb, QPointF &zero);
+    //! Marks the seeds lying on the segment from \a a to \a b as used
+    void useSeeds(const QPointF &a, const QPointF &b);
+    //! Follows the curve from \a start in the \a direction of the tangent, appending the points to \a points
+    /** \a closed is set to true if the curve came back to \a start. */
+    void follow(const QPointF &start, const QPointF &direction, QVector<QPointF> &points, bool &closed);
+};
+
+//! \class QuadtreeContour Finds the curve f(x, y) = 0 with a quadtree and marching squares
+/** The area is divided into square cells on a coarse grid. A cell is subdivided
+  recursively only if the sign of f changes among its corners and centre, or if f is
+  small compared to its change over the cell (the curve may pass through without
+  a sign change at the samples). Cells of the finest level (leaves) are resolved
+  with marching squares and the segments are stitched into polylines.
+
+  The values are sampled on a lattice with the spacing of the leaves and shared between
+  neighbouring cells, so the number of evaluations grows with the length of the curve
+  rather than with the area. Cells for which ImplicitSource::mayContainZero() is false
+  are dropped before any of their points is evaluated.
+
+  Rows of the coarse grid (bands) are processed in parallel where the source can be
+  copied for other threads. Segments of the bands are joined in the order of the bands
+  and stitched together, so the result is the same for any number of threads. */
+class QuadtreeContour : private ParallelTask
+{
+  public:
+    //! Creates the engine with leaves of \a vLeafSize pixels
+    QuadtreeContour(ImplicitSource &vSource, double vLeafSize);
+
+    //! Finds the curve in the area of \a width x \a height pixels and draws it on \a polyline
+    void trace(int width, int height, PolylineBuilder &polyline);
+
+    //! Number of evaluations done by the last trace()
+    inline int evaluationCount() const
+    { return _evaluationCount; }
+
+  private:
+    //! \struct Segment A segment of the curve inside a leaf, between two edges of the lattice
+    struct Segment
+    {
+      qint64 startEdge, endEdge;
+      QPointF start, end;
+      bool used;
+    };
+
+    //! \struct Band The values and segments found in a row of the coarse grid
+    /** Values on the borders between bands are computed in both of them. */
+    struct Band
+    {
+      //! Source of the worker processing the band
+      ImplicitSource *source;
+      //! Values at the lattice points (and the middles of edges and leaves), NaN where undefined
+      QHash<qint64, double> values;
+      QVector<Segment> segments;
+      int evaluationCount;
+    };
+
+    //! Source of the values
+    ImplicitSource &_source;
+    //! Spacing of the lattice
+    double _leafSize;
+    int _evaluationCount;
+
+    // State of the current trace()
+    WorkerSources *_sources;
+    //! Number of leaves in a row of the area
+    int _columns;
+    QVector<Band> _bands;
+    //! Segments of all bands
+    QVector<Segment> _segments;
+    //! Indices of segments ending on the given edge (at most two)
+    QHash<qint64, int> _edgeFirst, _edgeSecond;
+
+    //! Processes the band \a index with the source of \a worker
+    void run(int index, int worker);
+    //! Returns the value at the lattice point (\a i2 / 2, \a j2 / 2); odd coordinates address the middles of edges and leaves
+    double value(Band &band, int i2, int j2);
+    //! Processes the cell with the top left corner (\a i, \a j) and side \a size in lattice units
+    void subdivide(Band &band, int i, int j, int size);
+    //! Finds the segments of the curve in the leaf (\a i, \a j)
+    void march(Band &band, int i, int j);
+    //! Finds the point where the curve crosses the edge (\a i, \a j, \a vertical) with values \a a and \a b at the ends
+    /** Returns false if the sign changes at a pole rather than at a zero. */
+    bool crossing(Band &band, int i, int j, int vertical, double a, double b, QPointF &point);
+    //! Adds a segment between the given edges
+    void addSegment(Band &band, qint64 edgeA, const QPointF &a, qint64 edgeB, const QPointF &b);
+    //! Returns the other segment ending on \a edge than \a segment, or -1
+    int neighbour(qint64 edge, int segment) const;
+    //! Joins the segments of the bands into polylines and draws them
+    void stitch(PolylineBuilder &polyline);
+};
+
+#endif // _QMPLOT_IMPLICIT_H
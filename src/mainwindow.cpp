@@ -17,7 +17,16 @@
 #include <QPixmap>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFile>
+#include <QProgressDialog>
 #include <QCloseEvent>
+#include <cmath>
+
+
+// Largest image in pixels exported through a pixmap; larger ones can only be exported to TIFF
+const double MAX_EXPORT_PIXELS = 256.0 * 1024.0 * 1024.0;
+// Time in milliseconds after which the progress of an export is shown
+const int EXPORT_PROGRESS_DELAY = 500;
 
 
 // -------- MainWindow --------
@@ -44,6 +53,7 @@ MainWindow::MainWindow(QWidget *parent)
   _ui->setupUi(this);
   connect(this, SIGNAL(languageChanged()),
           _ui->fColorButton, SLOT(retranslateUi()));
+  _ui->plot->setTileCacheSize(_settingsData.tileCacheSize);
 
   _functionDB = new FunctionDB();
   _currentFunction = NULL;
@@ -176,11 +186,17 @@ MainWindow::MainWindow(QWidget *parent)
           this, SLOT(pMaxParamChanged(double, bool)));
   connect(_ui->pParamStepEdit, SIGNAL(editingFinished(double, bool)),
           this, SLOT(pParamStepChanged(double, bool)));
+  connect(_ui->pAdaptiveStepCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(pAdaptiveStepChanged(bool)));
 
   // Implicit function
 
   connect(_ui->iFormulaEdit, SIGNAL(editingFinished()),
           this, SLOT(iFormulaChanged()));
+  connect(_ui->iMethodComboBox, SIGNAL(currentIndexChanged(int)),
+          this, SLOT(iMethodChanged(int)));
+  connect(_ui->iShadingCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(iShadingChanged(bool)));
   connect(_ui->iDrawAccuracyEdit, SIGNAL(editingFinished(double, bool)),
           this, SLOT(iDrawAccuracyChanged(double, bool)));
 
@@ -307,6 +323,8 @@ void MainWindow::loadSettings()
                          QVariant(_settingsData.warnUnsavedNew)).toBool();
   _settingsData.warnUnsavedAtExit = _settings->value("ui/warn_unsaved_exit",
                          QVariant(_settingsData.warnUnsavedAtExit)).toBool();
+  _settingsData.tileCacheSize = _settings->value("plot/tile_cache_size",
+                         QVariant(_settingsData.tileCacheSize)).toInt();
 }
 
 void MainWindow::saveSettings()
@@ -316,6 +334,7 @@ void MainWindow::saveSettings()
   _settings->setValue("ui/language_index", QVariant(_settingsData.language));
   _settings->setValue("ui/warn_unsaved_new", QVariant(_settingsData.warnUnsavedNew));
   _settings->setValue("ui/warn_unsaved_exit", QVariant(_settingsData.warnUnsavedAtExit));
+  _settings->setValue("plot/tile_cache_size", QVariant(_settingsData.tileCacheSize));
 }
 
 void MainWindow::settingsChanged(const Settings &newSettings)
@@ -332,6 +351,7 @@ void MainWindow::settingsChanged(const Settings &newSettings)
 
   TreeParser::setNumberFormat(_settingsData.numberFormat);
   TreeParser::setNumberPrecision(_settingsData.numberPrecision);
+  _ui->plot->setTileCacheSize(_settingsData.tileCacheSize);
 }
 
 void MainWindow::retranslate()
@@ -344,6 +364,12 @@ void MainWindow::retranslate()
              this, SLOT(cMinFChanged(bool)));
   disconnect(_ui->cMaxCheckBox, SIGNAL(toggled(bool)),
              this, SLOT(cMaxFChanged(bool)));
+  disconnect(_ui->iMethodComboBox, SIGNAL(currentIndexChanged(int)),
+             this, SLOT(iMethodChanged(int)));
+  disconnect(_ui->iShadingCheckBox, SIGNAL(toggled(bool)),
+             this, SLOT(iShadingChanged(bool)));
+  disconnect(_ui->pAdaptiveStepCheckBox, SIGNAL(toggled(bool)),
+             this, SLOT(pAdaptiveStepChanged(bool)));
   _ui->retranslateUi(this);
   connect(_ui->fWidthSpinBox, SIGNAL(valueChanged(double)),
           this, SLOT(fWidthChanged(double)));
@@ -353,6 +379,12 @@ void MainWindow::retranslate()
           this, SLOT(cMinFChanged(bool)));
   connect(_ui->cMaxCheckBox, SIGNAL(toggled(bool)),
           this, SLOT(cMaxFChanged(bool)));
+  connect(_ui->iMethodComboBox, SIGNAL(currentIndexChanged(int)),
+          this, SLOT(iMethodChanged(int)));
+  connect(_ui->iShadingCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(iShadingChanged(bool)));
+  connect(_ui->pAdaptiveStepCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(pAdaptiveStepChanged(bool)));
 
   if (_fileName.isEmpty())
     setWindowTitle(tr("QMPlot - %1[*]").arg(tr("Untitled")));
@@ -415,6 +447,7 @@ void MainWindow::functionListItemChanged(QListWidgetItem *item)
   if (_currentFunction->enabled() != enabled)
   {
     _currentFunction->enabled() = enabled;
+    _functionDB->appearanceChanged();
     _ui->plot->update();
   }
 }
@@ -539,6 +572,12 @@ void MainWindow::functionChanged()
              this, SLOT(cMinFChanged(bool)));
   disconnect(_ui->cMaxCheckBox, SIGNAL(toggled(bool)),
              this, SLOT(cMaxFChanged(bool)));
+  disconnect(_ui->iMethodComboBox, SIGNAL(currentIndexChanged(int)),
+             this, SLOT(iMethodChanged(int)));
+  disconnect(_ui->iShadingCheckBox, SIGNAL(toggled(bool)),
+             this, SLOT(iShadingChanged(bool)));
+  disconnect(_ui->pAdaptiveStepCheckBox, SIGNAL(toggled(bool)),
+             this, SLOT(pAdaptiveStepChanged(bool)));
 
   _ui->fNameEdit->setText(_currentFunction->name());
   _ui->fWidthSpinBox->setValue(_currentFunction->width());
@@ -611,6 +650,7 @@ void MainWindow::functionChanged()
       _ui->pMinParamEdit->setValue(pFunction->minParam());
       _ui->pMaxParamEdit->setValue(pFunction->maxParam());
       _ui->pParamStepEdit->setValue(pFunction->paramStep());
+      _ui->pAdaptiveStepCheckBox->setChecked(pFunction->adaptiveStep());
 
       pFunction = NULL;
       break;
@@ -632,7 +672,19 @@ void MainWindow::functionChanged()
       iFormulaChanged();
       _ui->iFormulaEdit->enableSignal();
 
+      if (iFunction->method() == IM_Scan)
+        _ui->iMethodComboBox->setCurrentIndex(0);
+      else if (iFunction->method() == IM_Quadtree)
+        _ui->iMethodComboBox->setCurrentIndex(1);
+      else if (iFunction->method() == IM_Raster)
+        _ui->iMethodComboBox->setCurrentIndex(2);
+      else if (iFunction->method() == IM_Trace)
+        _ui->iMethodComboBox->setCurrentIndex(3);
+
       _ui->iDrawAccuracyEdit->setValue(iFunction->drawAccuracy());
+      // Drawing accuracy is the step of the column scan
+      _ui->iDrawAccuracyEdit->setEnabled(iFunction->method() == IM_Scan);
+      _ui->iShadingCheckBox->setChecked(iFunction->shading());
 
       iFunction = NULL;
       break;
@@ -647,6 +699,12 @@ void MainWindow::functionChanged()
           this, SLOT(cMinFChanged(bool)));
   connect(_ui->cMaxCheckBox, SIGNAL(toggled(bool)),
           this, SLOT(cMaxFChanged(bool)));
+  connect(_ui->iMethodComboBox, SIGNAL(currentIndexChanged(int)),
+          this, SLOT(iMethodChanged(int)));
+  connect(_ui->iShadingCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(iShadingChanged(bool)));
+  connect(_ui->pAdaptiveStepCheckBox, SIGNAL(toggled(bool)),
+          this, SLOT(pAdaptiveStepChanged(bool)));
 }
 
 void MainWindow::fNameChanged()
@@ -684,6 +742,7 @@ void MainWindow::fWidthChanged(double value)
 
   setWindowModified(true);
   _currentFunction->width() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -693,6 +752,7 @@ void MainWindow::fColorChanged(const QColor &color)
 
   setWindowModified(true);
   _currentFunction->color() = color;
+  _functionDB->appearanceChanged();
 
   QListWidgetItem *item = _ui->functionsList->currentItem();
   Q_ASSERT(item != NULL);
@@ -716,6 +776,8 @@ void MainWindow::cTypeChanged(int type)
     subtype = CT_YToX;
 
   (static_cast<CartesianFunction*>(_currentFunction))->subtype() = subtype;
+  // Calls of the function give the other variable
+  _functionDB->functionChanged(_currentFunction->name());
 
   functionChanged();
 }
@@ -732,6 +794,8 @@ void MainWindow::cFormulaChanged()
   {
     _ui->cFormulaStatus->setText(generateErrorMessage(cFunction->formula().status()));
     _ui->cFormulaStatusIcon->setPixmap(QPixmap(":/img/critical.png"));
+    // Functions calling it can't compute it any more
+    _functionDB->functionChanged(cFunction->name());
   }
   else
   {
@@ -757,6 +821,7 @@ void MainWindow::cMinFChanged(bool on)
 
   setWindowModified(true);
   (static_cast<CartesianFunction*>(_currentFunction))->minF() = on;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->cMinEdit->setEnabled(on);
   _ui->plot->update();
 }
@@ -770,6 +835,7 @@ void MainWindow::cMinChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<CartesianFunction*>(_currentFunction))->min() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -780,6 +846,7 @@ void MainWindow::cMaxFChanged(bool on)
 
   setWindowModified(true);
   (static_cast<CartesianFunction*>(_currentFunction))->maxF() = on;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->cMaxEdit->setEnabled(on);
   _ui->plot->update();
 }
@@ -793,6 +860,7 @@ void MainWindow::cMaxChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<CartesianFunction*>(_currentFunction))->max() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -806,6 +874,8 @@ void MainWindow::pXFormulaChanged()
   {
     _ui->pXFormulaStatus->setText(generateErrorMessage(pFunction->xFormula().status()));
     _ui->pXFormulaStatusIcon->setPixmap(QPixmap(":/img/critical.png"));
+    // Functions calling it can't compute it any more
+    _functionDB->functionChanged(pFunction->name());
   }
   else
   {
@@ -834,6 +904,8 @@ void MainWindow::pYFormulaChanged()
   {
     _ui->pYFormulaStatus->setText(generateErrorMessage(pFunction->yFormula().status()));
     _ui->pYFormulaStatusIcon->setPixmap(QPixmap(":/img/critical.png"));
+    // Functions calling it can't compute it any more
+    _functionDB->functionChanged(pFunction->name());
   }
   else
   {
@@ -861,6 +933,7 @@ void MainWindow::pMinParamChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<ParametricFunction*>(_currentFunction))->minParam() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -873,6 +946,7 @@ void MainWindow::pMaxParamChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<ParametricFunction*>(_currentFunction))->maxParam() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -885,6 +959,18 @@ void MainWindow::pParamStepChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<ParametricFunction*>(_currentFunction))->paramStep() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
+  _ui->plot->update();
+}
+
+void MainWindow::pAdaptiveStepChanged(bool on)
+{
+  Q_ASSERT(_currentFunction != NULL);
+  Q_ASSERT(_currentFunction->type() == FT_Parametric);
+
+  setWindowModified(true);
+  (static_cast<ParametricFunction*>(_currentFunction))->adaptiveStep() = on;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -898,6 +984,8 @@ void MainWindow::iFormulaChanged()
   {
     _ui->iFormulaStatus->setText(generateErrorMessage(iFunction->formula().status()));
     _ui->iFormulaStatusIcon->setPixmap(QPixmap(":/img/critical.png"));
+    // Functions calling it can't compute it any more
+    _functionDB->functionChanged(iFunction->name());
   }
   else
   {
@@ -916,6 +1004,29 @@ void MainWindow::iFormulaChanged()
   _ui->plot->update();
 }
 
+void MainWindow::iMethodChanged(int method)
+{
+  Q_ASSERT(_currentFunction != NULL);
+  Q_ASSERT(_currentFunction->type() == FT_Implicit);
+
+  setWindowModified(true);
+
+  ImplicitMethod iMethod = IM_Scan;
+  if (method == 0)
+    iMethod = IM_Scan;
+  else if (method == 1)
+    iMethod = IM_Quadtree;
+  else if (method == 2)
+    iMethod = IM_Raster;
+  else if (method == 3)
+    iMethod = IM_Trace;
+
+  (static_cast<ImplicitFunction*>(_currentFunction))->method() = iMethod;
+  _functionDB->propertiesChanged(_currentFunction->name());
+
+  functionChanged();
+}
+
 void MainWindow::iDrawAccuracyChanged(double value, bool valid)
 {
   Q_ASSERT(_currentFunction != NULL);
@@ -931,6 +1042,18 @@ void MainWindow::iDrawAccuracyChanged(double value, bool valid)
 
   setWindowModified(true);
   (static_cast<ImplicitFunction*>(_currentFunction))->drawAccuracy() = value;
+  _functionDB->propertiesChanged(_currentFunction->name());
+  _ui->plot->update();
+}
+
+void MainWindow::iShadingChanged(bool on)
+{
+  Q_ASSERT(_currentFunction != NULL);
+  Q_ASSERT(_currentFunction->type() == FT_Implicit);
+
+  setWindowModified(true);
+  (static_cast<ImplicitFunction*>(_currentFunction))->shading() = on;
+  _functionDB->propertiesChanged(_currentFunction->name());
   _ui->plot->update();
 }
 
@@ -1212,12 +1335,60 @@ void MainWindow::actionExport()
 void MainWindow::exportDialogAccepted()
 {
   ExportData data = _exportDialog->data();
-  _ui->plot->exportPlot(data);
 
-  bool result = data.pixmap->save(data.fileName);
+  QString suffix = QFileInfo(data.fileName).suffix().toLower();
+  bool tiff = (suffix == "tif") || (suffix == "tiff");
+  bool vector = (suffix == "svg") || (suffix == "pdf");
+  if ((!tiff) && (!vector))
+  {
+    double pixels = floor((data.xMax - data.xMin) * data.scale) *
+                    floor((data.yMax - data.yMin) * data.scale);
+    if (pixels > MAX_EXPORT_PIXELS)
+    {
+      QMessageBox::critical(this, tr("QMPlot - Error"),
+                            tr("The image is too large for this format. Export it to a TIFF file instead."),
+                            QMessageBox::Ok);
+      return;
+    }
+  }
+
+  // Raster images are drawn in the background, so the progress is shown and the export can be cancelled
+  QProgressDialog progress(tr("Exporting the plot..."), tr("Cancel"), 0, 100, this);
+  progress.setWindowModality(Qt::WindowModal);
+  progress.setMinimumDuration(EXPORT_PROGRESS_DELAY);
+  connect(_ui->plot, SIGNAL(exportProgress(int)), &progress, SLOT(setValue(int)));
+  connect(&progress, SIGNAL(canceled()), _ui->plot, SLOT(cancelExport()));
+
+  bool result = false;
+  if (suffix == "svg")
+  {
+    result = _ui->plot->exportPlotSvg(data);
+  }
+  else if (suffix == "pdf")
+  {
+    result = _ui->plot->exportPlotPdf(data);
+  }
+  else if (tiff)
+  {
+    // Drawn and written in bands, so the size isn't limited by memory
+    result = _ui->plot->exportPlotTiff(data);
+  }
+  else if (_ui->plot->exportPlot(data))
+  {
+    result = data.pixmap->save(data.fileName);
+
+    delete data.pixmap;
+    data.pixmap = NULL;
+  }
 
-  delete data.pixmap;
-  data.pixmap = NULL;
+  if (progress.wasCanceled())
+  {
+    // A cancelled export isn't saved and an incomplete TIFF file is removed
+    if (tiff)
+      QFile::remove(data.fileName);
+    return;
+  }
+  progress.reset();
 
   if (!result)
     QMessageBox::critical(this, tr("QMPlot - Error"),
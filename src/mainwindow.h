@@ -89,11 +89,14 @@ class MainWindow : public QMainWindow
     void pMinParamChanged(double value, bool valid);
     void pMaxParamChanged(double value, bool valid);
     void pParamStepChanged(double value, bool valid);
+    void pAdaptiveStepChanged(bool on);
 
     // Implicit function
 
     void iFormulaChanged();
+    void iMethodChanged(int method);
     void iDrawAccuracyChanged(double value, bool valid);
+    void iShadingChanged(bool on);
 
     // View properties dock events
 
@@ -0,0 +1,88 @@
+/* parallel.cpp - implements the ParallelTask class and parallelFor(), which run independent
+                  parts of work on the worker threads.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "parallel.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QVector>
+#include <QtAlgorithms>
+
+
+//! \class ParallelWorker Takes the parts of a ParallelTask one by one until there are none left
+class ParallelWorker : public QRunnable
+{
+  public:
+    ParallelWorker(ParallelTask &vTask, QAtomicInt &vNext, int vCount, int vWorker, QSemaphore &vDone)
+      : _task(vTask), _next(vNext), _count(vCount), _worker(vWorker), _done(vDone)
+    {
+      setAutoDelete(false);
+    }
+
+    void run()
+    {
+      work();
+      _done.release();
+    }
+
+    void work()
+    {
+      for (;;)
+      {
+        int index = _next.fetchAndAddOrdered(1);
+        if (index >= _count) break;
+
+        _task.run(index, _worker);
+      }
+    }
+
+  private:
+    ParallelTask &_task;
+    //! Index of the next part to run, shared by the workers
+    QAtomicInt &_next;
+    int _count;
+    int _worker;
+    //! Released when the worker has finished
+    QSemaphore &_done;
+};
+
+
+int parallelWorkerCount(int count)
+{
+  return qMax(1, qMin(count, QThread::idealThreadCount()));
+}
+
+void parallelFor(ParallelTask &task, int count, int workers)
+{
+  if (count <= 0) return;
+
+  QAtomicInt next(0);
+  QSemaphore done;
+
+  QVector<ParallelWorker*> started;
+  QThreadPool *pool = QThreadPool::globalInstance();
+  for (int w = 1; w < qMin(workers, count); ++w)
+  {
+    ParallelWorker *worker = new ParallelWorker(task, next, count, w, done);
+    if (!pool->tryStart(worker))
+    {
+      delete worker;
+      break;
+    }
+    started.append(worker);
+  }
+
+  ParallelWorker self(task, next, count, 0, done);
+  self.work();
+
+  done.acquire(started.size());
+  qDeleteAll(started);
+}
@@ -0,0 +1,37 @@
+/* parallel.h - defines the ParallelTask class and parallelFor(), which run independent
+                parts of work on the worker threads.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_PARALLEL_H
+#define _QMPLOT_PARALLEL_H
+
+
+//! \class ParallelTask Work divided into numbered parts which can be done concurrently
+class ParallelTask
+{
+  public:
+    virtual ~ParallelTask() {}
+
+    //! Does the part \a index of the work on the worker \a worker
+    /** Workers are numbered from 0 (the calling thread) and each one runs its parts one at
+      a time, so data indexed by the worker (e.g. copies of parsers) needs no locking.
+      Results should be stored by \a index and combined in that order afterwards,
+      so that they don't depend on the number of threads or on timing. */
+    virtual void run(int index, int worker) = 0;
+};
+
+//! Returns the number of workers worth using for \a count parts
+/** It is at least 1 and at most the number of processor cores. */
+int parallelWorkerCount(int count);
+
+//! Runs the parts 0 .. \a count - 1 of \a task on at most \a workers workers and waits for them
+/** The calling thread is worker 0 and works as well. Other workers are taken from the
+  global thread pool only if they are free, so the call can't deadlock when it is
+  nested or the pool is busy; the calling thread then does more of the parts. */
+void parallelFor(ParallelTask &task, int count, int workers);
+
+#endif // _QMPLOT_PARALLEL_H
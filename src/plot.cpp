@@ -8,6 +8,8 @@
 
 #include "plot.h"
 #include "function.h"
+#include "exporter.h"
+#include "tiffwriter.h"
 
 #include <QPaintEvent>
 #include <QMouseEvent>
@@ -17,17 +19,26 @@
 #include <QFont>
 #include <QFontMetrics>
 #include <QPen>
+#include <QTimer>
+#include <QImage>
+#include <QDomDocument>
+#include <QEventLoop>
+#include <QSvgGenerator>
+#include <QPdfWriter>
+#include <QPageSize>
+#include <QMarginsF>
 #include <cmath>
 
 using namespace std;
 
-/* Minumum value of unit, because lower values will probably be
-  useless due to accuracy loss */
-const double MIN_UNIT = 1e-12;
 // Minimum pixel scale, lower values don't make much sense
 const double MIN_SCALE = 1e-6;
-// Useful shorthand
-const double SQRT_3 = sqrt(3.0);
+// Coarseness of the first draft after zooming
+const int DRAFT_COARSENESS = 4;
+// Time (ms) without input after which the draft is refined
+const int REFINE_DELAY = 150;
+// Memory for a band of rows of an image exported to TIFF, in bytes
+const int EXPORT_BAND_SIZE = 16 * 1024 * 1024;
 
 PlotArea::PlotArea(QWidget *parent) : QWidget(parent)
 {
@@ -38,17 +49,35 @@ PlotArea::PlotArea(QWidget *parent) : QWidget(parent)
   _manualAxisUnit = 1.0;
   _baseTx = _baseTy = 0.0;
   _drawFlag = true;
-  _axisFont = new QFont("Arial", 10, QFont::Bold);
-  _fontMetrics = new QFontMetrics(*_axisFont);
+  _coarseness = 1;
+  _backgroundAxisUnit = 0.0;
+  _renderRevision = 0;
   setFocusPolicy(Qt::WheelFocus);
+
+  _refineTimer = new QTimer(this);
+  _refineTimer->setSingleShot(true);
+  connect(_refineTimer, SIGNAL(timeout()), this, SLOT(refine()));
+
+  _renderer = new PlotRenderer(this);
+  connect(_renderer, SIGNAL(frameReady()), this, SLOT(update()), Qt::QueuedConnection);
+  connect(_renderer, SIGNAL(recursionDetected(const QString&)),
+          this, SLOT(renderRecursion(const QString&)), Qt::QueuedConnection);
+
+  _exporter = new PlotExporter(this);
+  connect(_exporter, SIGNAL(progress(int, int)),
+          this, SLOT(exporterProgress(int, int)), Qt::QueuedConnection);
+  _exportCancelled = false;
+  _exportHeight = 0;
+  _exportPercent = -1;
 }
 
 PlotArea::~PlotArea()
 {
-  delete _axisFont;
-  _axisFont = NULL;
-  delete _fontMetrics;
-  _fontMetrics = NULL;
+  // Stops the thread before the widget is gone
+  delete _renderer;
+  _renderer = NULL;
+  delete _exporter;
+  _exporter = NULL;
 }
 
 void PlotArea::reset()
@@ -59,6 +88,8 @@ void PlotArea::reset()
   _manualAxisUnitF = false;
   _manualAxisUnit = 1.0;
   _baseTx = _baseTy = 0.0;
+  _coarseness = 1;
+  _refineTimer->stop();
   emit translateXChanged(_tX);
   emit translateYChanged(_tY);
   emit unitScaleChanged(_scale);
@@ -94,13 +125,23 @@ void PlotArea::setManualAxisUnitF(bool vOn)
 
 bool PlotArea::setManualAxisUnit(double vValue)
 {
-  if (vValue < MIN_UNIT) return false;
+  if (vValue < PlotAxes::MIN_UNIT) return false;
   _manualAxisUnit = vValue;
   updateAxisUnit();
   update();
   return true;
 }
 
+void PlotArea::setTileCacheSize(int vMegabytes)
+{
+  _renderer->setCacheSize(vMegabytes);
+}
+
+bool PlotArea::isRendering()
+{
+  return _renderer->isBusy();
+}
+
 void PlotArea::mousePressEvent(QMouseEvent *e)
 {
   if (e->button() == Qt::LeftButton)
@@ -147,6 +188,7 @@ void PlotArea::keyPressEvent(QKeyEvent *e)
       _scale = _scale * 1.1;
       emit unitScaleChanged(_scale);
       updateAxisUnit();
+      startDraft();
       update();
       break;
     }
@@ -155,6 +197,7 @@ void PlotArea::keyPressEvent(QKeyEvent *e)
       _scale = _scale * 0.9;
       emit unitScaleChanged(_scale);
       updateAxisUnit();
+      startDraft();
       update();
       break;
     }
@@ -197,6 +240,29 @@ void PlotArea::wheelEvent(QWheelEvent *e)
   _scale = _scale * (1.0 + 0.1 * (e->delta() / 120.0));
   emit unitScaleChanged(_scale);
   updateAxisUnit();
+  startDraft();
+  update();
+}
+
+void PlotArea::startDraft()
+{
+  // Further input postpones the refinement, so it never runs while the user is zooming
+  _coarseness = DRAFT_COARSENESS;
+  _refineTimer->start(REFINE_DELAY);
+}
+
+void PlotArea::refine()
+{
+  if (_coarseness <= 1) return;
+
+  _coarseness /= 2;
+  update();
+}
+
+void PlotArea::renderRecursion(const QString &functionName)
+{
+  FunctionDB::instance()->disableFunctions();
+  emit recursionDetected(functionName);
   update();
 }
 
@@ -206,7 +272,6 @@ void PlotArea::resizeEvent(QResizeEvent *)
   update();
 }
 
-// A bit complex algorithm to find the appropriate units
 void PlotArea::updateAxisUnit()
 {
   if (_manualAxisUnitF)
@@ -214,314 +279,267 @@ void PlotArea::updateAxisUnit()
     _axisUnit = _manualAxisUnit;
     return;
   }
-  _axisUnit = pow(10.0, ceil(-log10(_scale * 0.5)) + 1.0);
-
-  double w = width() / _scale;
-  double xMin = _tX - w * 0.5;
-  double xMax = _tX + w * 0.5;
-  int ndiv = 0;
-  int prevAction = 0;
-  while (true)
-  {
-    double testX = abs(floor(max(abs(xMin), abs(xMax))) / _axisUnit) * _axisUnit;
-    int tw1 = _fontMetrics->width(QString().setNum(testX, 'g'));
-    int tw2 = _fontMetrics->width(QString().setNum(testX + _axisUnit, 'g'));
-    // Discovered through trial and error
-    if ((_axisUnit * _scale - 0.25 * (tw1 + tw2) < 15.0) && (prevAction != 2))
-    {
-      prevAction = 1;
-      switch (ndiv)
-      {
-        case 0:
-        {
-          _axisUnit *= 2.0;
-          ndiv = 1;
-          break;
-        }
-        case 1:
-        {
-          _axisUnit *= (2.5/2.0);
-          ndiv = 2;
-          break;
-        }
-        case 2:
-        {
-          _axisUnit *= (5.0/2.5);
-          ndiv = 3;
-          break;
-        }
-        case 3:
-        {
-          _axisUnit *= (10.0/5.0);
-          ndiv = 0;
-          break;
-        }
-        default: {}
-      }
-    }
-    else if ((_axisUnit * _scale - 0.25 * (tw1 + tw2) > (5.0 * ((tw1 + tw2) / 2.0))) && (prevAction != 1))
-    {
-      prevAction = 2;
-      switch (ndiv)
-      {
-        case 0:
-        {
-          _axisUnit /= 2.0;
-          ndiv = 1;
-          break;
-        }
-        case 1:
-        {
-          _axisUnit /= (2.5/2.0);
-          ndiv = 2;
-          break;
-        }
-        case 2:
-        {
-          _axisUnit /= (5.0/2.5);
-          ndiv = 3;
-          break;
-        }
-        case 3:
-        {
-          _axisUnit /= (10.0/5.0);
-          ndiv = 0;
-          break;
-        }
-        default: {}
-      }
-    }
-    else
-    {
-      break;
-    }
-  }
+  _axisUnit = _axes.autoUnit(view(width(), height()));
 
   emit axisUnitChanged(_axisUnit);
 }
 
-void PlotArea::exportPlot(ExportData &data)
+bool PlotArea::exportPlot(ExportData &data)
 {
   Q_ASSERT(data.pixmap == NULL);
 
-  double oldScale = _scale;
-  double oldTx = _tX;
-  double oldTy = _tY;
-
-  _scale = data.scale;
-  _tX = (data.xMax + data.xMin) / 2.0;
-  _tY = (data.yMax + data.yMin) / 2.0;
-
-  data.pixmap = new QPixmap((int)(floor((data.xMax - data.xMin) * data.scale)),
-                            (int)(floor((data.yMax - data.yMin) * data.scale)));
+  _exportCancelled = false;
 
-  QPainter p(data.pixmap);
-  paint(p, data.pixmap->width(), data.pixmap->height());
+  RenderView exported = PlotExporter::exportView(data);
+  QImage image(exported.width, exported.height, QImage::Format_RGB32);
+  if (image.isNull())
+    return false;
 
-  _scale = oldScale;
-  _tX = oldTx;
-  _tY = oldTy;
-}
-
-void PlotArea::paintEvent(QPaintEvent *e)
-{
-  e->accept();
+  if (!exportArea(data, image, image.rect()))
+    return false;
 
-  QPainter p(this);
-  paint(p, width(), height());
+  data.pixmap = new QPixmap(QPixmap::fromImage(image));
+  return true;
 }
 
-void PlotArea::paint(QPainter &p, int width, int height)
+bool PlotArea::exportPlotTiff(const ExportData &data)
 {
-  p.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
-  p.fillRect(QRect(0, 0, width, height), Qt::white);
+  _exportCancelled = false;
 
-  QPen axisPen = p.pen();
+  RenderView exported = PlotExporter::exportView(data);
+  QSize size(exported.width, exported.height);
+  if (size.isEmpty())
+    return false;
 
-  QPen gridPen = p.pen();
-  gridPen.setColor(Qt::lightGray);
-  gridPen.setWidthF(0.5);
+  // Whole rows of tiles, so that the image is the same as if it was drawn at once
+  int bandRows = EXPORT_BAND_SIZE / (4 * size.width());
+  bandRows = qMax(bandRows - bandRows % PlotRenderer::TILE_SIZE, PlotRenderer::TILE_SIZE);
+  bandRows = qMin(bandRows, size.height());
 
-  QPen borderFontPen = p.pen();
-  borderFontPen.setColor(QColor("#707070"));
+  TiffWriter writer;
+  if (!writer.open(data.fileName, size.width(), size.height(), bandRows))
+    return false;
 
-  p.setFont(*_axisFont);
-  p.setBrush(QBrush(Qt::black));
+  QImage band(size.width(), bandRows, QImage::Format_RGB32);
+  bool result = true;
+  for (int top = 0; result && (top < size.height()); top += bandRows)
+  {
+    int rows = qMin(bandRows, size.height() - top);
 
-  double w = width / _scale;
-  double h = height / _scale;
+    result = exportArea(data, band, QRect(0, top, size.width(), rows)) &&
+             writer.writeStrip(band, rows);
+  }
 
-  double xMin = _tX - w * 0.5;
-  double xMax = _tX + w * 0.5;
-  double yMin = _tY - h * 0.5;
-  double yMax = _tY + h * 0.5;
+  // close() also fails if not all strips were written
+  return writer.close() && result;
+}
 
-  double xAxis = width * 0.5 - _tX * _scale;
-  double yAxis = height * 0.5 + _tY * _scale;
+bool PlotArea::exportPlotSvg(const ExportData &data)
+{
+  RenderView exported = PlotExporter::exportView(data);
+  QSize size(exported.width, exported.height);
+  if (size.isEmpty())
+    return false;
+
+  QSvgGenerator svg;
+  svg.setFileName(data.fileName);
+  svg.setSize(size);
+  svg.setViewBox(QRect(QPoint(0, 0), size));
+  svg.setResolution(PlotExporter::VECTOR_RESOLUTION);
+  svg.setTitle(tr("QMPlot plot"));
+
+  return paintVector(&svg, data);
+}
 
-  int borderSize = _fontMetrics->height();
+bool PlotArea::exportPlotPdf(const ExportData &data)
+{
+  RenderView exported = PlotExporter::exportView(data);
+  QSize size(exported.width, exported.height);
+  if (size.isEmpty())
+    return false;
+
+  // A pixel of the plot is a dot of the page
+  QPdfWriter pdf(data.fileName);
+  pdf.setResolution(PlotExporter::VECTOR_RESOLUTION);
+  pdf.setPageSize(QPageSize(QSizeF(size) / PlotExporter::VECTOR_RESOLUTION, QPageSize::Inch));
+  pdf.setPageMargins(QMarginsF(0.0, 0.0, 0.0, 0.0));
+  pdf.setTitle(tr("QMPlot plot"));
+
+  return paintVector(&pdf, data);
+}
 
-  // Draw grid
-  p.setPen(gridPen);
+void PlotArea::cancelExport()
+{
+  _exportCancelled = true;
+  _exporter->cancel();
+}
 
-  for (double y = floor(yMin / _axisUnit) * _axisUnit; y < yMax; y += _axisUnit)
-    p.drawLine(QPointF(0.0, height - (y - yMin) * _scale),
-               QPointF(width, height - (y - yMin) * _scale));
+void PlotArea::paintEvent(QPaintEvent *e)
+{
+  e->accept();
 
-  for (double x = floor(xMin / _axisUnit) * _axisUnit; x < xMax; x += _axisUnit)
-    p.drawLine(QPointF((x - xMin) * _scale, 0.0),
-               QPointF((x - xMin) * _scale, height));
+  // During drag, the tiles not in the cache of the renderer are drawn as a draft
+  RenderView currentView = view(width(), height());
+  if (!_drawFlag)
+    currentView.coarseness = DRAFT_COARSENESS;
 
-  p.setPen(axisPen);
+  // Only the revision is compared, so painting doesn't depend on the number of functions
+  QMap<QString, QString> definitions;
+  bool functionsChanged = (FunctionDB::instance()->revision() != _renderRevision);
+  if (functionsChanged)
+    updateRenderFunctions(definitions);
 
-  // Draw axis only if in view
-  if ((xAxis > 0.0) && (xAxis < width))
+  if ((currentView != _renderView) || functionsChanged)
   {
-    p.drawLine(QPointF(xAxis, 0.0), QPointF(xAxis, height));
-    // Arrow
-    QVector<QPointF> v;
-    v.push_back(QPointF(xAxis, 0.0));
-    v.push_back(QPointF(xAxis - 5.0, 5.0 * SQRT_3));
-    v.push_back(QPointF(xAxis + 5.0, 5.0 * SQRT_3));
-    p.drawConvexPolygon(QPolygonF(v));
+    _renderView = currentView;
+    _renderer->render(_renderView, _renderFunctions, definitions);
   }
 
-  // Draw labels - next to axis
-  if ((xAxis > 0.0) && (xAxis < width))
-  {
-    for (double y = floor(yMin / _axisUnit) * _axisUnit; y < yMax; y += _axisUnit)
-    {
-      p.drawLine(QPointF(xAxis - 2.0, height - (y - yMin) * _scale),
-                 QPointF(xAxis + 2.0, height - (y - yMin) * _scale));
-      if (fabs(y) > MIN_UNIT)
-      {
-        QString text = QString().setNum(y, 'g');
-        int tw = _fontMetrics->width(text);
-        p.drawText(QRectF(xAxis + 5.0,
-                          height - (y - yMin) * _scale - _fontMetrics->height() / 2.0,
-                          tw,
-                          _fontMetrics->height()),
-                   text, QTextOption(Qt::AlignCenter));
-      }
-    }
-  }
-  // On the border
-  else
+  // The background is drawn again only for another view or axis unit
+  RenderView backgroundView = view(width(), height());
+  backgroundView.coarseness = 1;
+  if ((backgroundView != _backgroundView) || (_axisUnit != _backgroundAxisUnit) || _background.isNull())
   {
-    p.setPen(borderFontPen);
-    for (double y = floor(yMin / _axisUnit) * _axisUnit; y < yMax; y += _axisUnit)
-    {
-      if (fabs(y) > MIN_UNIT)
-      {
-        QString text = QString().setNum(y, 'g');
-        int tw = _fontMetrics->width(text);
-        if (tw > borderSize)
-          borderSize = tw;
-
-        if (xAxis > 0.0)
-        {
-          p.drawText(QRectF(width - tw,
-                            height - (y - yMin) * _scale - _fontMetrics->height() / 2.0,
-                            tw,
-                            _fontMetrics->height()),
-                     text, QTextOption(Qt::AlignCenter));
-        }
-        else
-        {
-          p.drawText(QRectF(0.0,
-                            height - (y - yMin) * _scale - _fontMetrics->height() / 2.0,
-                            tw,
-                            _fontMetrics->height()),
-                     text, QTextOption(Qt::AlignCenter));
-        }
-      }
-    }
-    p.setPen(axisPen);
-  }
+    _background = QPixmap(width(), height());
+    QPainter backgroundPainter(&_background);
+    _axes.paint(backgroundPainter, backgroundView, _axisUnit);
+    backgroundPainter.end();
 
-  if ((yAxis > 0.0) && (yAxis < height))
-  {
-    p.drawLine(QPointF(0.0, yAxis), QPointF(width, yAxis));
-    QVector<QPointF> v;
-    v.push_back(QPointF(width, yAxis));
-    v.push_back(QPointF(width - 5.0 * SQRT_3, yAxis + 5.0));
-    v.push_back(QPointF(width - 5.0 * SQRT_3, yAxis - 5.0));
-    p.drawConvexPolygon(QPolygonF(v));
+    _backgroundView = backgroundView;
+    _backgroundAxisUnit = _axisUnit;
   }
 
-  if ((yAxis > 0.0) && (yAxis < height))
+  QPainter p(this);
+  p.drawPixmap(0, 0, _background);
+
+  // The last frame, moved and scaled to the current view
+  RenderView frameView;
+  QImage frame = _renderer->frame(frameView);
+  if (!frame.isNull())
   {
-    for (double x = floor(xMin / _axisUnit) * _axisUnit; x < xMax; x += _axisUnit)
-    {
-      p.drawLine(QPointF((x - xMin) * _scale, yAxis - 2.0),
-                 QPointF((x - xMin) * _scale, yAxis + 2.0));
-      if (fabs(x) > MIN_UNIT)
-      {
-        QString text = QString().setNum(x, 'g');
-        int tw = _fontMetrics->width(text);
-        p.drawText(QRectF((x - xMin) * _scale - tw / 2.0,
-                          yAxis + 5.0,
-                          tw,
-                          _fontMetrics->height()),
-                   text, QTextOption(Qt::AlignCenter));
-      }
-    }
+    double ratio = _scale / frameView.scale;
+    double frameWidth = frameView.width * ratio;
+    double frameHeight = frameView.height * ratio;
+    double left = (frameView.xMin - currentView.xMin) * _scale;
+    double bottom = height() - (frameView.yMin - currentView.yMin) * _scale;
+    p.drawImage(QRectF(left, bottom - frameHeight, frameWidth, frameHeight), frame);
   }
-  else
+
+  bool busy = _renderer->isBusy();
+  if (busy)
   {
-    p.setPen(borderFontPen);
-    for (double x = floor(xMin / _axisUnit) * _axisUnit; x < xMax; x += _axisUnit)
-    {
-      if (fabs(x) > MIN_UNIT)
-      {
-        QString text = QString().setNum(x, 'g');
-        int tw = _fontMetrics->width(text);
-        if (yAxis < 0.0)
-        {
-          p.drawText(QRectF((x - xMin) * _scale - tw / 2.0, 0.0,
-                            tw,
-                            _fontMetrics->height()),
-                     text, QTextOption(Qt::AlignCenter));
-        }
-        else
-        {
-          p.drawText(QRectF((x - xMin) * _scale - tw / 2.0,
-                            height - _fontMetrics->height(),
-                            tw,
-                            _fontMetrics->height()),
-                     text, QTextOption(Qt::AlignCenter));
-        }
-      }
-    }
-    p.setPen(axisPen);
+    QString text = tr("Rendering...");
+    QRectF textRect(5.0, 5.0, _axes.fontMetrics().width(text) + 6.0,
+                    _axes.fontMetrics().height() + 2.0);
+    p.fillRect(textRect, QColor(255, 255, 255, 192));
+    p.setPen(QColor("#707070"));
+    p.drawText(textRect, text, QTextOption(Qt::AlignCenter));
   }
 
-  if (!_drawFlag)
+  p.end();
+
+  // Each refinement of the draft is a separate pass, so input in between can interrupt them
+  if ((_coarseness > 1) && (!busy) && (!_refineTimer->isActive()))
+    _refineTimer->start(0);
+}
+
+bool PlotArea::exportArea(const ExportData &data, QImage &image, const QRect &area)
+{
+  QPainter p(&image);
+  p.translate(-area.topLeft());
+  p.setClipRect(area);
+  RenderView exported = PlotExporter::exportView(data);
+  _axes.paint(p, exported, _axisUnit);
+  p.end();
+
+  QDomDocument document;
+  FunctionDB::instance()->saveDocument(document);
+
+  _exportArea = area;
+  _exportHeight = exported.height;
+  _exportPercent = -1;
+
+  QEventLoop loop;
+  connect(_exporter, SIGNAL(finished()), &loop, SLOT(quit()));
+  _exporter->exportArea(exported, document.toString(), &image, area);
+  loop.exec();
+  _exporter->wait();
+
+  QString functionName = _exporter->recursionFunction();
+  if (!functionName.isEmpty())
+    renderRecursion(functionName);
+
+  return _exporter->isComplete() && (!_exportCancelled);
+}
+
+bool PlotArea::paintVector(QPaintDevice *device, const ExportData &data)
+{
+  QPainter p;
+  if (!p.begin(device))
+    return false;
+
+  RenderView exported = PlotExporter::exportView(data);
+  _axes.paint(p, exported, _axisUnit);
+  QString functionName = PlotRenderer::paintFunctions(p, exported, QRect(0, 0, exported.width, exported.height),
+                                                      NULL, PlotExporter::VECTOR_TOLERANCE);
+  if (!functionName.isEmpty())
+    renderRecursion(functionName);
+
+  return p.end() && functionName.isEmpty();
+}
+
+void PlotArea::exporterProgress(int done, int count)
+{
+  int percent = static_cast<int>(100.0 * (_exportArea.top() + _exportArea.height() * done / count) /
+                                 _exportHeight);
+  // Workers report in any order
+  if (percent > _exportPercent)
   {
-    p.end();
-    return;
+    _exportPercent = percent;
+    emit exportProgress(percent);
   }
+}
 
-  FunctionPaintParams params;
-  params.area = QRect(0, 0, width, height);
-  params.xMin = xMin;
-  params.yMin = yMin;
-  params.scale = _scale;
+RenderView PlotArea::view(int width, int height) const
+{
+  RenderView result;
+  result.width = width;
+  result.height = height;
+  result.xMin = _tX - (width / _scale) * 0.5;
+  result.yMin = _tY - (height / _scale) * 0.5;
+  result.scale = _scale;
+  result.coarseness = _coarseness;
+  return result;
+}
 
-  QList<Function*> functionList = FunctionDB::instance()->functionList();
-  FunctionDB::instance()->clearRecursionError();
-  for (QList<Function*>::iterator it = functionList.begin(); it != functionList.end(); ++it)
+void PlotArea::updateRenderFunctions(QMap<QString, QString> &definitions)
+{
+  FunctionDB *functionDB = FunctionDB::instance();
+  QList<Function*> functionList = functionDB->functionList();
+
+  QList<RenderFunction> functions;
+  QHash<QString, unsigned long> definitionRevisions;
+  for (int i = 0; i < functionList.size(); ++i)
   {
-    (*it)->paint(p, params);
-    // Break on recursion
-    if (FunctionDB::instance()->recursionError())
+    Function *function = functionList.at(i);
+
+    RenderFunction renderFunction;
+    renderFunction.name = function->name();
+    renderFunction.enabled = function->enabled();
+    renderFunction.color = function->color();
+    functions.append(renderFunction);
+
+    // Only new and changed functions are saved for the renderer
+    definitionRevisions.insert(function->name(), function->definitionRevision());
+    if (_renderDefinitions.value(function->name()) != function->definitionRevision())
     {
-      FunctionDB::instance()->disableFunctions();
-      // This signal must be connected asynchronously or else we get into recursive paintEvent()s
-      emit recursionDetected((*it)->name());
-      break;
+      QDomDocument document;
+      document.appendChild(functionDB->saveFunction(document, function));
+      definitions.insert(function->name(), document.toString());
     }
   }
 
-  p.end();
+  _renderFunctions = functions;
+  _renderDefinitions = definitionRevisions;
+  _renderRevision = functionDB->revision();
 }
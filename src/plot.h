@@ -10,17 +10,35 @@
 #define _QMPLOT_PLOT_H
 
 #include "common.h"
+#include "renderer.h"
+#include "axes.h"
 
 #include <QString>
 #include <QMap>
+#include <QHash>
+#include <QList>
 #include <QWidget>
 #include <QPoint>
 #include <QPixmap>
+#include <QRect>
+
+class QTimer;
+class QPaintDevice;
+class PlotExporter;
 
 //! \class PlotArea Widget drawing and exporting function plots
 /** The class draws all enabled functions from FunctionDB and detects recursion.
 User can zoom in and out and translate the view. There is also an exportPlot()
-function for exporting plot to a file. */
+function for exporting plot to a file.
+
+The functions are drawn in the background by PlotRenderer, so that expensive ones don't block
+the user interface. Until the frame of the current view is ready, the last one is shown,
+moved and scaled to the view, with a note that the plot is being rendered.
+The renderer is given a new job when the view or the revision of the functions changes
+(see FunctionDB::revision()), with the definitions of only the changed functions.
+
+The grid, axes and labels are kept in a pixmap, which is drawn again only when the view
+or the axis unit changes, so new frames of the functions don't draw them. */
 class PlotArea : public QWidget
 {
   Q_OBJECT
@@ -52,11 +70,31 @@ class PlotArea : public QWidget
     void setManualAxisUnitF(bool vOn);
     //! Returns false if \a vUnit is below minimum value
     bool setManualAxisUnit(double vUnit);
+    //! Sets the memory limit of the cache of drawn tiles in megabytes
+    void setTileCacheSize(int vMegabytes);
+    //! Returns true while the functions are drawn in the background
+    bool isRendering();
 
     //! Exports the plot given the export data
     /** \a data should contain valid fileName and other values but pixmap should be NULL
-        because it will be created in the function and should be destroyed afterwards. */
-    void exportPlot(ExportData &data);
+        because it will be created in the function and should be destroyed afterwards.
+        Returns false and leaves pixmap NULL if the export was cancelled or failed.
+
+        The functions are drawn by PlotExporter on all cores; events are processed meanwhile,
+        so a progress dialog can call cancelExport(). */
+    bool exportPlot(ExportData &data);
+    //! Exports the plot given the export data to a TIFF file, drawing it in bands of rows
+    /** Only one band of the image is in memory at a time, so it can be much larger than a pixmap.
+        pixmap of \a data isn't used. Returns false if the file can't be written or the export
+        was cancelled. */
+    bool exportPlotTiff(const ExportData &data);
+    //! Exports the plot given the export data to an SVG file
+    /** The curves are written as paths, simplified so that they differ from the samples by at most
+        a fraction of a pixel. pixmap of \a data isn't used. Returns false if the file can't be written. */
+    bool exportPlotSvg(const ExportData &data);
+    //! Exports the plot given the export data to a PDF file of the size of the image at 96 dpi
+    /** The curves are simplified as for exportPlotSvg(). */
+    bool exportPlotPdf(const ExportData &data);
 
   protected:
     void paintEvent(QPaintEvent *);
@@ -67,6 +105,10 @@ class PlotArea : public QWidget
     void wheelEvent(QWheelEvent *e);
     void resizeEvent(QResizeEvent *);
 
+  public slots:
+    //! Cancels the export in progress
+    void cancelExport();
+
   signals:
     void unitScaleChanged(double scale);
     void translateXChanged(double tx);
@@ -75,6 +117,16 @@ class PlotArea : public QWidget
     //! Emitted when recursion was detected.
     /** \a functionName is the name of function which caused the recursion. */
     void recursionDetected(const QString &functionName);
+    //! Emitted during an export with the \a percent of the image drawn
+    void exportProgress(int percent);
+
+  private slots:
+    //! Doubles the resolution of the draft and repaints
+    void refine();
+    //! Disables the functions after recursion was detected by the renderer
+    void renderRecursion(const QString &functionName);
+    //! Emits exportProgress() when \a done of \a count tiles of the exported area are drawn
+    void exporterProgress(int done, int count);
 
   private:
     //! Pixel scale
@@ -91,18 +143,51 @@ class PlotArea : public QWidget
     QPoint _mouseBasePos;
     //! Base translate values on drag
     double _baseTx, _baseTy;
-    //! Whether to draw functions (false during drag)
+    //! Whether to draw functions at full resolution (false during drag)
     bool _drawFlag;
-    //! Font for drawing units
-    QFont *_axisFont;
-    //! Font metrics of the above
-    QFontMetrics *_fontMetrics;
+    //! Draws the functions in the background
+    PlotRenderer *_renderer;
+    //! View, functions and revision of the functions (see FunctionDB::revision()) of the last job given to _renderer
+    RenderView _renderView;
+    QList<RenderFunction> _renderFunctions;
+    unsigned long _renderRevision;
+    //! Definition revisions (see Function::definitionRevision()) of the functions given to _renderer, by their names
+    QHash<QString, unsigned long> _renderDefinitions;
+    //! Draws the functions of exported images
+    PlotExporter *_exporter;
+    //! True if the export in progress was cancelled
+    bool _exportCancelled;
+    //! Area of the exported image being drawn, height of the image and the last percent emitted
+    QRect _exportArea;
+    int _exportHeight, _exportPercent;
+    /** Resolution at which functions are drawn (see FunctionPaintParams::coarseness);
+      after zooming a draft is drawn first and refined when idle */
+    int _coarseness;
+    //! Timer starting the next refinement of the draft
+    QTimer *_refineTimer;
+    //! Draws the grid, axes and labels and chooses the automatic axis unit
+    PlotAxes _axes;
+    //! Grid, axes and labels of the last painted view
+    QPixmap _background;
+    //! View and axis unit of _background
+    RenderView _backgroundView;
+    double _backgroundAxisUnit;
 
     //! Auto-scales axis units
     void updateAxisUnit();
-    /** Paints the plot on given painter
-      (used both in painting on widget and exporting) */
-    void paint(QPainter &p, int width, int height);
+    //! Switches to drawing a draft, which is refined once there is no further input
+    void startDraft();
+    //! Draws the part \a area of the image exported with \a data on \a image, which holds only the area
+    /** The background is painted here and the functions by _exporter, processing events until
+        it has finished. Returns false if the export was cancelled or recursion was detected. */
+    bool exportArea(const ExportData &data, QImage &image, const QRect &area);
+    //! Paints the image exported with \a data on the vector \a device, simplifying the curves
+    /** Returns false if the device can't be painted on or recursion was detected. */
+    bool paintVector(QPaintDevice *device, const ExportData &data);
+    //! Returns the current view of the plot of the given size
+    RenderView view(int width, int height) const;
+    //! Sets _renderFunctions to the functions of FunctionDB and adds those changed since the last job to \a definitions
+    void updateRenderFunctions(QMap<QString, QString> &definitions);
 };
 
 
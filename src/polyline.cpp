@@ -0,0 +1,224 @@
+/* polyline.cpp - implements the PolylineBuilder class, which collects points of plotted curves
+                  and draws them as clipped polylines.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "polyline.h"
+
+#include <QVector>
+#include <QPair>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+/* Coordinates are clamped to this, so that the arithmetic of clipping doesn't overflow.
+  The change of direction of such segments is invisible. */
+const double MAX_COORDINATE = 1e9;
+
+
+PolylineBuilder::PolylineBuilder(QPainter &vPainter, const QRectF &vClipRect)
+  : _painter(&vPainter), _clipRect(vClipRect)
+{
+  _tolerance = 0.0;
+  _hasLastPoint = false;
+}
+
+PolylineBuilder::PolylineBuilder(const QRectF &vClipRect)
+  : _painter(NULL), _clipRect(vClipRect)
+{
+  _tolerance = 0.0;
+  _hasLastPoint = false;
+}
+
+PolylineBuilder::~PolylineBuilder()
+{
+  flush();
+}
+
+void PolylineBuilder::addPoint(const QPointF &point)
+{
+  // Non-finite points are replayed as breaks
+  if (_painter == NULL)
+  {
+    _recorded.append(point);
+    return;
+  }
+
+  // x - x is NaN for both infinities and NaN
+  if ((point.x() - point.x() != 0.0) || (point.y() - point.y() != 0.0))
+  {
+    breakLine();
+    return;
+  }
+
+  QPointF clamped(qBound(-MAX_COORDINATE, point.x(), MAX_COORDINATE),
+                  qBound(-MAX_COORDINATE, point.y(), MAX_COORDINATE));
+
+  if (!_hasLastPoint)
+  {
+    _lastPoint = clamped;
+    _hasLastPoint = true;
+    return;
+  }
+
+  QPointF a = _lastPoint, b = clamped;
+  _lastPoint = clamped;
+
+  if (!clipSegment(_clipRect, a, b))
+  {
+    flush();
+    return;
+  }
+
+  // The segment enters the rectangle somewhere else than the polyline has left it
+  if ((!_polyline.isEmpty()) && (_polyline.last() != a))
+    flush();
+
+  if (_polyline.isEmpty())
+    _polyline.append(a);
+  _polyline.append(b);
+
+  // The segment leaves the rectangle
+  if (b != clamped)
+    flush();
+}
+
+void PolylineBuilder::breakLine()
+{
+  if (_painter == NULL)
+  {
+    double nan = numeric_limits<double>::quiet_NaN();
+    _recorded.append(QPointF(nan, nan));
+    return;
+  }
+
+  flush();
+  _hasLastPoint = false;
+}
+
+void PolylineBuilder::flush()
+{
+  if (_tolerance > 0.0)
+    simplify(_polyline, _tolerance);
+
+  if (_polyline.size() >= 2)
+    _painter->drawPolyline(_polyline);
+
+  _polyline.clear();
+}
+
+void PolylineBuilder::setTolerance(double vTolerance)
+{
+  _tolerance = qMax(vTolerance, 0.0);
+}
+
+void PolylineBuilder::replay(PolylineBuilder &target) const
+{
+  for (int i = 0; i < _recorded.size(); ++i)
+    target.addPoint(_recorded.at(i));
+}
+
+// Liang-Barsky algorithm
+bool PolylineBuilder::clipSegment(const QRectF &rect, QPointF &a, QPointF &b)
+{
+  double dx = b.x() - a.x();
+  double dy = b.y() - a.y();
+
+  // For each border: p * t <= q must hold for points inside
+  double p[4] = { -dx, dx, -dy, dy };
+  double q[4] = { a.x() - rect.left(), rect.right() - a.x(),
+                  a.y() - rect.top(), rect.bottom() - a.y() };
+
+  double t0 = 0.0, t1 = 1.0;
+  for (int i = 0; i < 4; ++i)
+  {
+    if (p[i] == 0.0)
+    {
+      // Parallel to the border and outside of it
+      if (q[i] < 0.0) return false;
+      continue;
+    }
+
+    double t = q[i] / p[i];
+    if (p[i] < 0.0)
+    {
+      if (t > t1) return false;
+      if (t > t0) t0 = t;
+    }
+    else
+    {
+      if (t < t0) return false;
+      if (t < t1) t1 = t;
+    }
+  }
+
+  QPointF start = a;
+  if (t0 > 0.0)
+    a = QPointF(start.x() + t0 * dx, start.y() + t0 * dy);
+  if (t1 < 1.0)
+    b = QPointF(start.x() + t1 * dx, start.y() + t1 * dy);
+
+  return true;
+}
+
+void PolylineBuilder::simplify(QPolygonF &points, double tolerance)
+{
+  int count = points.size();
+  if (count <= 2) return;
+
+  QVector<bool> keep(count, false);
+  keep[0] = keep[count - 1] = true;
+
+  // Ranges of points left to simplify, kept on a stack instead of recursion
+  QVector<QPair<int, int> > ranges;
+  ranges.append(qMakePair(0, count - 1));
+  double toleranceSquared = tolerance * tolerance;
+
+  while (!ranges.isEmpty())
+  {
+    QPair<int, int> range = ranges.last();
+    ranges.pop_back();
+
+    const QPointF a = points.at(range.first);
+    double dx = points.at(range.second).x() - a.x();
+    double dy = points.at(range.second).y() - a.y();
+    double lengthSquared = dx * dx + dy * dy;
+
+    // The point farthest from the segment between the ends of the range
+    int farthest = -1;
+    double farthestDistance = toleranceSquared;
+    for (int i = range.first + 1; i < range.second; ++i)
+    {
+      double px = points.at(i).x() - a.x();
+      double py = points.at(i).y() - a.y();
+      double t = (lengthSquared > 0.0) ? qBound(0.0, (px * dx + py * dy) / lengthSquared, 1.0) : 0.0;
+      double ex = px - t * dx;
+      double ey = py - t * dy;
+      double distance = ex * ex + ey * ey;
+      if (distance > farthestDistance)
+      {
+        farthest = i;
+        farthestDistance = distance;
+      }
+    }
+
+    if (farthest < 0) continue;
+
+    keep[farthest] = true;
+    if (farthest - range.first > 1)
+      ranges.append(qMakePair(range.first, farthest));
+    if (range.second - farthest > 1)
+      ranges.append(qMakePair(farthest, range.second));
+  }
+
+  int kept = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    if (keep.at(i))
+      points[kept++] = points.at(i);
+  }
+  points.resize(kept);
+}
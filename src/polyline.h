@@ -0,0 +1,93 @@
+/* polyline.h - defines the PolylineBuilder class, which collects points of plotted curves
+                and draws them as clipped polylines.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_POLYLINE_H
+#define _QMPLOT_POLYLINE_H
+
+#include <QPainter>
+#include <QPolygonF>
+#include <QRectF>
+#include <QPointF>
+
+
+//! \class PolylineBuilder Draws a curve given point by point as a few polylines
+/** Points are added in the order of the curve. Contiguous points are joined into one
+  polyline and drawn with a single drawPolyline() call, which is much cheaper than
+  drawing every segment on its own.
+
+  The segments are clipped to the given rectangle, so that points far off the
+  painted area (e.g. near asymptotes) don't reach the painter. The parts of the
+  curve which are entirely outside are dropped and the polyline is broken there.
+
+  The curve can also be broken explicitly with breakLine(), e.g. on invalid samples.
+
+  With a tolerance set, each polyline is simplified before it is drawn (see simplify()),
+  which keeps files of vector formats small, where every point of the samples would be kept.
+
+  A builder created without a painter only records the points and breaks, which can be
+  given to another builder later by replay(). Parts of a curve can thus be computed
+  in worker threads and drawn in order by the thread owning the painter. */
+class PolylineBuilder
+{
+  public:
+    //! Creates the builder drawing on \a vPainter and clipping to \a vClipRect
+    /** \a vClipRect should be somewhat larger than the visible area,
+        so that wide lines are not cut off at the edges. */
+    PolylineBuilder(QPainter &vPainter, const QRectF &vClipRect);
+    //! Creates the builder recording the points for replay()
+    /** \a vClipRect is not used for clipping here, only returned by clipRect(). */
+    explicit PolylineBuilder(const QRectF &vClipRect);
+    //! Draws what is left
+    ~PolylineBuilder();
+
+    //! Adds the next point of the curve, joining it with the previous one
+    /** Non-finite coordinates break the line. */
+    void addPoint(const QPointF &point);
+
+    //! Breaks the curve, so that the next point is not joined with the previous one
+    void breakLine();
+
+    //! Draws the current polyline
+    void flush();
+
+    //! Sets the distance in pixels by which the drawn polylines may deviate from the points; 0 keeps all points
+    void setTolerance(double vTolerance);
+
+    //! Adds the points and breaks recorded by this builder to \a target in the same order
+    void replay(PolylineBuilder &target) const;
+
+    inline const QRectF& clipRect() const
+    { return _clipRect; }
+
+    //! Clips the segment \a a - \a b to \a rect
+    /** Returns false if the segment lies entirely outside of the rectangle,
+        otherwise moves the ends onto its border if they were outside. */
+    static bool clipSegment(const QRectF &rect, QPointF &a, QPointF &b);
+
+    //! Removes the points of \a points which are at most \a tolerance away from the simplified polyline
+    /** Ramer-Douglas-Peucker algorithm; the ends are always kept. */
+    static void simplify(QPolygonF &points, double tolerance);
+
+  private:
+    //! Painter to draw on; NULL if the builder records
+    QPainter *_painter;
+    //! Clipping rectangle
+    QRectF _clipRect;
+    //! Tolerance of simplification in pixels
+    double _tolerance;
+    //! Points of the current polyline
+    QPolygonF _polyline;
+    //! Last point added (unclipped)
+    QPointF _lastPoint;
+    //! True if _lastPoint is valid, i.e. the next point is joined with it
+    bool _hasLastPoint;
+    //! Points recorded for replay(); breaks are stored as NaN points
+    QPolygonF _recorded;
+};
+
+#endif // _QMPLOT_POLYLINE_H
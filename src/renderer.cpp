@@ -0,0 +1,489 @@
+/* renderer.cpp - implements the PlotRenderer class, which draws the functions of the plot
+                  in a background thread.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "renderer.h"
+#include "function.h"
+
+#include <QPainter>
+#include <QMutexLocker>
+#include <QDomDocument>
+#include <QHash>
+#include <QPair>
+
+#include <cmath>
+
+
+//! Default memory limit of the tile cache in megabytes
+const int DEFAULT_CACHE_SIZE = 128;
+
+//! Largest tile index (in pixels of the plane) at which the plot is still split into tiles
+const double MAX_TILE_PIXEL = 1e15;
+
+
+PlotRenderer::PlotRenderer(QObject *parent) : QThread(parent)
+{
+  _hasJob = false;
+  _rendering = false;
+  _quit = false;
+  _cacheSize = DEFAULT_CACHE_SIZE * 1024;
+  _documentLayer = 0;
+  _nextLayerId = 0;
+}
+
+PlotRenderer::~PlotRenderer()
+{
+  {
+    QMutexLocker locker(&_mutex);
+    _quit = true;
+    _cancel.store(1);
+    _jobAdded.wakeOne();
+  }
+
+  wait();
+}
+
+void PlotRenderer::render(const RenderView &view, const QList<RenderFunction> &functions,
+                          const QMap<QString, QString> &definitions)
+{
+  QMutexLocker locker(&_mutex);
+
+  _jobView = view;
+  _jobFunctions = functions;
+  for (QMap<QString, QString>::const_iterator it = definitions.constBegin(); it != definitions.constEnd(); ++it)
+    _jobDefinitions.insert(it.key(), it.value());
+  _hasJob = true;
+  if (_rendering)
+    _cancel.store(1);
+
+  _jobAdded.wakeOne();
+
+  if (!isRunning())
+    start(QThread::LowPriority);
+}
+
+QImage PlotRenderer::frame(RenderView &view)
+{
+  QMutexLocker locker(&_mutex);
+
+  view = _frameView;
+  return _frame;
+}
+
+bool PlotRenderer::isBusy()
+{
+  QMutexLocker locker(&_mutex);
+
+  return _hasJob || _rendering;
+}
+
+void PlotRenderer::setCacheSize(int megabytes)
+{
+  QMutexLocker locker(&_mutex);
+
+  // Applied by the thread with the next job
+  _cacheSize = qMax(megabytes, 1) * 1024;
+}
+
+void PlotRenderer::run()
+{
+  // Copy of the functions, used only by this thread
+  FunctionDB *functionDB = NULL;
+
+  for (;;)
+  {
+    RenderView view;
+    QList<RenderFunction> functions;
+    QMap<QString, QString> definitions;
+    int cacheSize;
+    {
+      QMutexLocker locker(&_mutex);
+      while ((!_hasJob) && (!_quit))
+        _jobAdded.wait(&_mutex);
+
+      if (_quit) break;
+
+      view = _jobView;
+      functions = _jobFunctions;
+      definitions = _jobDefinitions;
+      _jobDefinitions.clear();
+      cacheSize = _cacheSize;
+      _hasJob = false;
+      _rendering = true;
+      _cancel.store(0);
+    }
+
+    _tiles.setMaxCost(cacheSize);
+
+    if (functionDB == NULL)
+    {
+      functionDB = new FunctionDB(true);
+      _functions.clear();
+    }
+
+    if ((functions != _functions) || (!definitions.isEmpty()))
+    {
+      updateFunctions(functions, definitions);
+      updateLayers();
+    }
+
+    QImage image = renderFrame(view);
+
+    bool complete = false;
+    {
+      QMutexLocker locker(&_mutex);
+      _rendering = false;
+      if ((_cancel.load() == 0) && (!image.isNull()))
+      {
+        _frame = image;
+        _frameView = view;
+        complete = true;
+      }
+    }
+
+    if (complete)
+      emit frameReady();
+  }
+
+  _tiles.clear();
+  _layers.clear();
+  _functions.clear();
+  delete functionDB;
+}
+
+void PlotRenderer::updateFunctions(const QList<RenderFunction> &functions,
+                                   const QMap<QString, QString> &definitions)
+{
+  FunctionDB *functionDB = FunctionDB::instance();
+
+  QStringList names;
+  for (int i = 0; i < functions.size(); ++i)
+    names.append(functions.at(i).name);
+
+  // The elements keep their documents
+  QList<QDomElement> elements;
+  for (QMap<QString, QString>::const_iterator it = definitions.constBegin(); it != definitions.constEnd(); ++it)
+  {
+    QDomDocument document;
+    if (document.setContent(it.value()))
+      elements.append(document.documentElement());
+  }
+
+  functionDB->updateFunctions(names, elements);
+
+  for (int i = 0; i < functions.size(); ++i)
+  {
+    Function *function = functionDB->function(functions.at(i).name);
+    if (function == NULL) continue;
+
+    function->enabled() = functions.at(i).enabled;
+    function->color() = functions.at(i).color;
+  }
+
+  _functions = functions;
+}
+
+void PlotRenderer::updateLayers()
+{
+  QList<Function*> functionList = FunctionDB::instance()->functionList();
+
+  /* The revision of a function changes with its definition and with those of the functions it
+     calls (see FunctionDB::functionChanged()). Disabled functions keep their identifiers, so their
+     tiles are used again when they are enabled. Identifiers of revisions no longer in the document
+     are dropped; their tiles age out of the cache. */
+  QHash<LayerRevision, int> layerIds;
+  _layers.clear();
+  for (int i = 0; i < functionList.size(); ++i)
+  {
+    Function *function = functionList.at(i);
+    LayerRevision revision(function->name(), function->revision());
+
+    int id = _layerIds.value(revision, -1);
+    if (id < 0)
+      id = _nextLayerId++;
+    layerIds.insert(revision, id);
+
+    if (!function->enabled()) continue;
+
+    Layer layer;
+    layer.function = function;
+    layer.id = id;
+    _layers.append(layer);
+  }
+  _layerIds = layerIds;
+
+  // The colors and the order of the functions are in the document
+  _documentLayer = _nextLayerId++;
+}
+
+QImage PlotRenderer::renderFrame(const RenderView &view)
+{
+  if ((view.width <= 0) || (view.height <= 0)) return QImage();
+
+  QImage frame(view.width, view.height, QImage::Format_ARGB32_Premultiplied);
+  frame.fill(Qt::transparent);
+
+  // The view in pixels of the plane
+  double left = view.xMin * view.scale;
+  double bottom = view.yMin * view.scale;
+
+  // Too far from the origin for tile indexes, so the view is drawn as a whole
+  if ((fabs(left) > MAX_TILE_PIXEL) || (fabs(bottom) > MAX_TILE_PIXEL) ||
+      (fabs(left + view.width) > MAX_TILE_PIXEL) || (fabs(bottom + view.height) > MAX_TILE_PIXEL))
+  {
+    QPainter p(&frame);
+    p.setRenderHints(QPainter::Antialiasing);
+    QString functionName = paintFunctions(p, view, QRect(0, 0, view.width, view.height), &_cancel);
+    p.end();
+
+    if (!functionName.isEmpty())
+    {
+      // The disabled functions don't match the job any more
+      _functions.clear();
+      emit recursionDetected(functionName);
+    }
+
+    return frame;
+  }
+
+  qint64 xFirst = static_cast<qint64>(floor(left / TILE_SIZE));
+  qint64 xLast = static_cast<qint64>(ceil((left + view.width) / TILE_SIZE)) - 1;
+  qint64 yFirst = static_cast<qint64>(floor(bottom / TILE_SIZE));
+  qint64 yLast = static_cast<qint64>(ceil((bottom + view.height) / TILE_SIZE)) - 1;
+
+  // Tiles of the document found in the cache
+  QHash<TilePosition, QImage> tiles;
+  QList<TilePosition> missing;
+  for (qint64 y = yFirst; y <= yLast; ++y)
+  {
+    for (qint64 x = xFirst; x <= xLast; ++x)
+    {
+      TilePosition position = qMakePair(x, y);
+      Tile *tile = cachedTile(view, position, _documentLayer);
+      if (tile != NULL)
+        tiles.insert(position, tile->image);
+      else
+        missing.append(position);
+    }
+  }
+
+  // The missing ones are put together from the tiles of the layers
+  if (!missing.isEmpty())
+  {
+    QHash<TilePosition, QImage> composed;
+    for (int i = 0; i < _layers.size(); ++i)
+    {
+      QHash<TilePosition, QImage> layerTiles;
+      if (!renderLayer(view, _layers.at(i), missing, layerTiles)) return QImage();
+
+      for (int j = 0; j < missing.size(); ++j)
+      {
+        QImage layerTile = layerTiles.value(missing.at(j));
+        if (layerTile.isNull()) continue;
+
+        QImage &tile = composed[missing.at(j)];
+        if (tile.isNull())
+        {
+          tile = layerTile;
+        }
+        else
+        {
+          QPainter p(&tile);
+          p.drawImage(0, 0, layerTile);
+        }
+      }
+    }
+
+    for (int i = 0; i < missing.size(); ++i)
+    {
+      QImage tile = composed.value(missing.at(i));
+      tiles.insert(missing.at(i), tile);
+      _tiles.insert(TileKey(view.scale, view.coarseness, missing.at(i).first, missing.at(i).second, _documentLayer),
+                    new Tile(tile, 0), qMax(tile.bytesPerLine() * tile.height() / 1024, 1));
+    }
+  }
+
+  QPainter p(&frame);
+  p.setCompositionMode(QPainter::CompositionMode_Source);
+  for (QHash<TilePosition, QImage>::const_iterator it = tiles.constBegin(); it != tiles.constEnd(); ++it)
+  {
+    if (it.value().isNull()) continue;
+
+    // Whole pixels, so the tiles meet without gaps
+    int x = static_cast<int>(floor(static_cast<double>(it.key().first) * TILE_SIZE - left + 0.5));
+    int y = static_cast<int>(floor(view.height - (static_cast<double>(it.key().second) + 1.0) * TILE_SIZE + bottom + 0.5));
+    p.drawImage(x, y, it.value());
+  }
+  p.end();
+
+  return frame;
+}
+
+Tile* PlotRenderer::cachedTile(const RenderView &view, const TilePosition &position, int layer)
+{
+  Tile *tile = NULL;
+  for (int coarseness = 1; (tile == NULL) && (coarseness <= view.coarseness); coarseness *= 2)
+    tile = _tiles.object(TileKey(view.scale, coarseness, position.first, position.second, layer));
+
+  return tile;
+}
+
+//! Returns true if nothing is drawn in \a image
+static bool isTransparent(const QImage &image)
+{
+  for (int y = 0; y < image.height(); ++y)
+  {
+    const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    for (int x = 0; x < image.width(); ++x)
+    {
+      if (line[x] != 0) return false;
+    }
+  }
+
+  return true;
+}
+
+bool PlotRenderer::renderLayer(const RenderView &view, const Layer &layer, const QList<TilePosition> &positions,
+                               QHash<TilePosition, QImage> &tiles)
+{
+  QRgb color = layer.function->color().rgb();
+
+  // Tiles found in the cache and the bounds of the missing ones
+  QList<TilePosition> missing;
+  qint64 xFirst = 0, xLast = -1, yFirst = 0, yLast = -1;
+  for (int i = 0; i < positions.size(); ++i)
+  {
+    const TilePosition &position = positions.at(i);
+    Tile *tile = cachedTile(view, position, layer.id);
+    if (tile != NULL)
+    {
+      // Only the color changed since it was drawn
+      if ((tile->color != color) && (!tile->image.isNull()))
+      {
+        QPainter p(&tile->image);
+        p.setCompositionMode(QPainter::CompositionMode_SourceIn);
+        p.fillRect(tile->image.rect(), QColor(color));
+      }
+      tile->color = color;
+      tiles.insert(position, tile->image);
+      continue;
+    }
+
+    if (missing.isEmpty())
+    {
+      xFirst = xLast = position.first;
+      yFirst = yLast = position.second;
+    }
+    xFirst = qMin(xFirst, position.first);
+    xLast = qMax(xLast, position.first);
+    yFirst = qMin(yFirst, position.second);
+    yLast = qMax(yLast, position.second);
+    missing.append(position);
+  }
+
+  if (missing.isEmpty()) return true;
+
+  // The missing tiles are drawn in one pass, so that the function is computed once for all of them
+  int columns = static_cast<int>(xLast - xFirst + 1);
+  int rows = static_cast<int>(yLast - yFirst + 1);
+
+  // Drawn with a margin, so lines crossing the edges of the tiles are complete
+  int margin = tileMargin(layer.function->width());
+
+  RenderView missingView;
+  missingView.width = columns * TILE_SIZE + 2 * margin;
+  missingView.height = rows * TILE_SIZE + 2 * margin;
+  missingView.xMin = (static_cast<double>(xFirst) * TILE_SIZE - margin) / view.scale;
+  missingView.yMin = (static_cast<double>(yFirst) * TILE_SIZE - margin) / view.scale;
+  missingView.scale = view.scale;
+  missingView.coarseness = view.coarseness;
+
+  QImage image(missingView.width, missingView.height, QImage::Format_ARGB32_Premultiplied);
+  image.fill(Qt::transparent);
+
+  FunctionPaintParams params;
+  params.area = QRect(0, 0, missingView.width, missingView.height);
+  params.xMin = missingView.xMin;
+  params.yMin = missingView.yMin;
+  params.scale = missingView.scale;
+  params.coarseness = missingView.coarseness;
+  params.cancel = &_cancel;
+
+  FunctionDB *functionDB = FunctionDB::instance();
+  functionDB->clearRecursionError();
+
+  QPainter p(&image);
+  p.setRenderHints(QPainter::Antialiasing);
+  layer.function->paint(p, params);
+  p.end();
+
+  if (functionDB->recursionError())
+  {
+    QString functionName = layer.function->name();
+    functionDB->disableFunctions();
+    // The disabled functions don't match the job any more
+    _functions.clear();
+    emit recursionDetected(functionName);
+    return false;
+  }
+
+  // Partly drawn tiles must not get into the cache
+  if (_cancel.load() != 0) return false;
+
+  for (int i = 0; i < missing.size(); ++i)
+  {
+    const TilePosition &position = missing.at(i);
+
+    // Rows of the image go down and rows of tiles go up
+    QImage tile = image.copy(margin + static_cast<int>(position.first - xFirst) * TILE_SIZE,
+                             margin + static_cast<int>(yLast - position.second) * TILE_SIZE,
+                             TILE_SIZE, TILE_SIZE);
+    if (isTransparent(tile))
+      tile = QImage();
+
+    tiles.insert(position, tile);
+    _tiles.insert(TileKey(view.scale, view.coarseness, position.first, position.second, layer.id),
+                  new Tile(tile, color), qMax(tile.bytesPerLine() * tile.height() / 1024, 1));
+  }
+
+  return true;
+}
+
+QString PlotRenderer::paintFunctions(QPainter &p, const RenderView &view, const QRect &area,
+                                     const QAtomicInt *cancel, double tolerance)
+{
+  // The values at the left and bottom edge of the area
+  FunctionPaintParams params;
+  params.area = area;
+  params.xMin = view.xMin + area.x() / view.scale;
+  params.yMin = view.yMin + (view.height - area.y() - area.height()) / view.scale;
+  params.scale = view.scale;
+  params.coarseness = view.coarseness;
+  params.tolerance = tolerance;
+  params.cancel = cancel;
+
+  FunctionDB *functionDB = FunctionDB::instance();
+  QList<Function*> functionList = functionDB->functionList();
+  functionDB->clearRecursionError();
+  for (QList<Function*>::iterator it = functionList.begin(); it != functionList.end(); ++it)
+  {
+    if (params.cancelled()) break;
+
+    // Functions translate and clip the painter to the area
+    p.save();
+    (*it)->paint(p, params);
+    p.restore();
+    // Break on recursion
+    if (functionDB->recursionError())
+    {
+      functionDB->disableFunctions();
+      return (*it)->name();
+    }
+  }
+
+  return QString();
+}
@@ -0,0 +1,244 @@
+/* renderer.h - defines the PlotRenderer class, which draws the functions of the plot
+                in a background thread.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_RENDERER_H
+#define _QMPLOT_RENDERER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QImage>
+#include <QString>
+#include <QRect>
+#include <QColor>
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QList>
+#include <cstring>
+
+class QPainter;
+class Function;
+
+//! \struct RenderView A view of the plot in which the functions are drawn
+struct RenderView
+{
+  RenderView()
+  { width = height = 0; xMin = yMin = 0.0; scale = 0.0; coarseness = 1; }
+
+  inline bool operator==(const RenderView &other) const
+  {
+    return (width == other.width) && (height == other.height) && (xMin == other.xMin) &&
+           (yMin == other.yMin) && (scale == other.scale) && (coarseness == other.coarseness);
+  }
+
+  inline bool operator!=(const RenderView &other) const
+  { return !(*this == other); }
+
+  //! Size of the plot in pixels
+  int width, height;
+  //! Minimum X and Y values
+  double xMin, yMin;
+  //! Pixel scale
+  double scale;
+  //! Resolution of a draft (see FunctionPaintParams::coarseness)
+  int coarseness;
+};
+
+//! \struct RenderFunction A function of a job of PlotRenderer, with the properties which change without its definition
+struct RenderFunction
+{
+  inline bool operator==(const RenderFunction &other) const
+  { return (name == other.name) && (enabled == other.enabled) && (color == other.color); }
+
+  QString name;
+  bool enabled;
+  QColor color;
+};
+
+//! \struct TileKey Identifies a tile of the plane drawn by PlotRenderer
+/** Tiles are squares of PlotRenderer::TILE_SIZE pixels aligned to the origin of the plane,
+  so the tile (x, y) covers X * scale in [x, x + 1) * TILE_SIZE and the same for Y. */
+struct TileKey
+{
+  TileKey(double vScale, int vCoarseness, qint64 vX, qint64 vY, int vLayer)
+    : scale(vScale), coarseness(vCoarseness), x(vX), y(vY), layer(vLayer) {}
+
+  inline bool operator==(const TileKey &other) const
+  {
+    return (scale == other.scale) && (coarseness == other.coarseness) && (x == other.x) &&
+           (y == other.y) && (layer == other.layer);
+  }
+
+  double scale;
+  int coarseness;
+  qint64 x, y;
+  //! Layer of the tile: one function or all functions of a document
+  int layer;
+};
+
+inline uint qHash(const TileKey &key)
+{
+  quint64 scaleBits;
+  memcpy(&scaleBits, &key.scale, sizeof scaleBits);
+  return qHash(scaleBits) ^ (qHash(key.x) * 31) ^ (qHash(key.y) * 1009) ^
+         (static_cast<uint>(key.coarseness) << 24) ^ static_cast<uint>(key.layer);
+}
+
+//! \struct Tile A tile in the cache of PlotRenderer
+struct Tile
+{
+  Tile(const QImage &vImage, QRgb vColor) : image(vImage), color(vColor) {}
+
+  //! The drawn tile; null if nothing is drawn in it
+  QImage image;
+  //! Color of the function in the tile of a function's layer
+  QRgb color;
+};
+
+//! \class PlotRenderer Draws the functions of the plot on a transparent image in a background thread
+/** A job is a view and the functions to draw. The thread keeps its own FunctionDB with copies of
+  the functions, so the functions of the main instance can be edited while a frame is drawn.
+  A job lists all functions, but gives the definitions (see FunctionDB::saveFunction()) only of
+  those which are new or changed; only these are read and parsed again by the thread
+  (see FunctionDB::updateFunctions()).
+
+  Frames are put together from tiles of the plane, which are kept in a cache with a memory limit,
+  dropping the least recently used ones. Only the tiles which are not in the cache are drawn,
+  at once, so panning back or returning to a previous scale costs only copying the tiles.
+  A draft may use tiles drawn at a finer resolution.
+
+  Each enabled function is drawn in its own layer, identified by its name and revision
+  (see Function::revision()), which changes with its definition and with those of the functions
+  it calls. The tiles of the whole document are put together from the tiles of the layers,
+  so editing a function draws only its layer and those of the functions calling it again,
+  and changing its color only recolors the tiles.
+
+  A new job cancels the one being drawn: its functions stop computing values as soon as they check
+  FunctionPaintParams::cancelled(). Only complete frames are given by frame(). */
+class PlotRenderer : public QThread
+{
+  Q_OBJECT
+
+  public:
+    //! Width and height of the tiles in pixels
+    static const int TILE_SIZE = 256;
+
+    //! Returns the margin in pixels drawn around tiles, so lines of \a lineWidth crossing their edges are complete
+    /** Half of the line reaches beyond its points, antialiasing and rounding a pixel each. */
+    static inline int tileMargin(double lineWidth)
+    { return static_cast<int>(lineWidth * 0.5) + 2; }
+
+    PlotRenderer(QObject *parent = NULL);
+    //! Cancels the job being drawn and waits for the thread to finish
+    ~PlotRenderer();
+
+    //! Starts drawing \a functions in \a view, cancelling the job being drawn
+    /** \a definitions are the saved functions, by their names, which changed since the last job.
+        Those of a job which was replaced before it was drawn are kept for the next one. */
+    void render(const RenderView &view, const QList<RenderFunction> &functions,
+                const QMap<QString, QString> &definitions);
+
+    //! Returns the last complete frame and sets \a view to the view it was drawn in
+    /** The frame is null if none has been completed yet. */
+    QImage frame(RenderView &view);
+
+    //! Returns true while a job is waiting or being drawn
+    bool isBusy();
+
+    //! Sets the memory limit of the tile cache in megabytes
+    void setCacheSize(int megabytes);
+
+    //! Paints the functions of FunctionDB::instance() in the part \a area of \a view
+    /** Stops when \a cancel (if given) is set. Curves are simplified by \a tolerance pixels
+        (see FunctionPaintParams::tolerance). If recursion is detected, the functions are
+        disabled and the name of the function which caused it is returned, else an empty string. */
+    static QString paintFunctions(QPainter &p, const RenderView &view, const QRect &area,
+                                  const QAtomicInt *cancel, double tolerance = 0.0);
+
+  signals:
+    //! Emitted by the thread when a frame is complete
+    void frameReady();
+    //! Emitted by the thread when recursion was detected in its copy of the functions
+    /** \a functionName is the name of function which caused the recursion. */
+    void recursionDetected(const QString &functionName);
+
+  protected:
+    void run();
+
+  private:
+    //! Guards the members below, except _cancel
+    QMutex _mutex;
+    //! Wakes the thread when a job is added or it should finish
+    QWaitCondition _jobAdded;
+    //! True if a job is waiting
+    bool _hasJob;
+    //! View, functions and changed definitions of the waiting job
+    RenderView _jobView;
+    QList<RenderFunction> _jobFunctions;
+    QMap<QString, QString> _jobDefinitions;
+    //! True while a job is drawn
+    bool _rendering;
+    //! True when the thread should finish
+    bool _quit;
+    //! Set to nonzero to cancel the job being drawn
+    QAtomicInt _cancel;
+    //! The last complete frame and its view
+    QImage _frame;
+    RenderView _frameView;
+    //! Memory limit of the tile cache in kilobytes
+    int _cacheSize;
+
+    // Used only by the thread
+
+    //! \struct Layer The layer of an enabled function of the thread's FunctionDB
+    struct Layer
+    {
+      Function *function;
+      int id;
+    };
+
+    typedef QPair<qint64, qint64> TilePosition;
+    //! Name and revision of a function
+    typedef QPair<QString, unsigned long> LayerRevision;
+
+    //! The functions of the thread's FunctionDB as given by the last job; empty if they must be set again
+    QList<RenderFunction> _functions;
+    //! Tiles drawn so far, with their size in kilobytes as the cost
+    QCache<TileKey, Tile> _tiles;
+    //! Layers of the functions, in the order of drawing
+    QList<Layer> _layers;
+    //! Identifiers of the layers by the revisions of their functions
+    QHash<LayerRevision, int> _layerIds;
+    //! Identifier of the layer of the whole document
+    int _documentLayer;
+    //! Next identifier given to a layer
+    int _nextLayerId;
+
+    //! Updates the thread's FunctionDB to the \a functions and changed \a definitions of a job
+    void updateFunctions(const QList<RenderFunction> &functions, const QMap<QString, QString> &definitions);
+
+    //! Sets the layers of the functions of the thread's FunctionDB, keeping the identifiers of unchanged ones
+    void updateLayers();
+
+    //! Puts the frame of \a view together from the tiles, drawing those which aren't in the cache
+    /** Returns a null image if the job was cancelled. */
+    QImage renderFrame(const RenderView &view);
+
+    //! Returns the finest tile of \a layer at \a position allowed in \a view, or NULL if none is cached
+    Tile* cachedTile(const RenderView &view, const TilePosition &position, int layer);
+
+    //! Sets \a tiles to the tiles of \a layer at \a positions, drawing those which aren't in the cache
+    /** Returns false if the job was cancelled or recursion was detected. */
+    bool renderLayer(const RenderView &view, const Layer &layer, const QList<TilePosition> &positions,
+                     QHash<TilePosition, QImage> &tiles);
+};
+
+#endif // _QMPLOT_RENDERER_H
@@ -0,0 +1,279 @@
+/* sampler.cpp - implements the CurveSampler class, which adaptively samples plotted curves.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "sampler.h"
+
+#include <cmath>
+using namespace std;
+
+
+// Maximum distance (in pixels) of the midpoint from the line between the ends of an interval
+const double TOLERANCE = 0.3;
+// Maximum number of subdivisions of the coarse interval (8 px coarse step gives 1/16 px)
+const int MAX_DEPTH = 7;
+// Budget of evaluations per coarse interval
+const int SAMPLES_PER_INTERVAL = 48;
+/* At the finest level, an interval whose ends are further apart than JUMP pixels and
+  which hasn't shrunk below JUMP_RATIO of its parent is a discontinuity. A continuous
+  function halves the distance with every subdivision, a jump keeps it. */
+const double JUMP = 2.0;
+const double JUMP_RATIO = 0.75;
+/* Position of the additional probe in the coarse intervals. With the midpoint alone,
+  an oscillation of the period of the coarse step would look like a straight line.
+  It is a multiple of 1/2^MAX_DEPTH, so that the probe falls on the same positions
+  as the subdivisions (see SampleCache). */
+const double PROBE_POSITION = 5.0 / 16.0;
+
+
+//! Returns the distance of point \a p from the line through \a a and \a b
+static double distanceFromLine(const QPointF &p, const QPointF &a, const QPointF &b)
+{
+  double dx = b.x() - a.x();
+  double dy = b.y() - a.y();
+  double length = sqrt(dx * dx + dy * dy);
+  if (length == 0.0)
+    return sqrt((p.x() - a.x()) * (p.x() - a.x()) + (p.y() - a.y()) * (p.y() - a.y()));
+
+  return fabs(dx * (a.y() - p.y()) - dy * (a.x() - p.x())) / length;
+}
+
+//! Returns the distance between points \a a and \a b
+static inline double distance(const QPointF &a, const QPointF &b)
+{
+  double dx = b.x() - a.x();
+  double dy = b.y() - a.y();
+  return sqrt(dx * dx + dy * dy);
+}
+
+
+CurveSampler::CurveSampler(CurveSource &vSource, PolylineBuilder &vPolyline)
+  : _source(vSource), _polyline(vPolyline)
+{
+  _sampleCount = 0;
+  _maxSamples = 0;
+  _maxDepth = MAX_DEPTH;
+  _minSegment = 0.0;
+  _maxSegment = 0.0;
+}
+
+void CurveSampler::sample(double uMin, double uMax, double coarseStep, double gridOrigin)
+{
+  _sampleCount = 0;
+  if ((uMin > uMax) || (coarseStep <= 0.0)) return;
+
+  int intervals = static_cast<int>(ceil((uMax - uMin) / coarseStep)) + 1;
+  _maxSamples = (intervals + 1) * SAMPLES_PER_INTERVAL;
+
+  Sample a = evaluate(uMin);
+  addSample(a);
+
+  // The first grid point after uMin
+  double first = floor((uMin - gridOrigin) / coarseStep) + 1.0;
+
+  for (int i = 0; i < intervals; ++i)
+  {
+    double u = gridOrigin + (first + i) * coarseStep;
+    if (u >= uMax)
+      u = uMax;
+
+    Sample b = evaluate(u);
+    refine(a, b, 0, 0.0);
+    a = b;
+
+    if (u >= uMax)
+      break;
+  }
+}
+
+CurveSampler::Sample CurveSampler::evaluate(double u)
+{
+  ++_sampleCount;
+
+  Sample s;
+  s.u = u;
+  s.valid = _source.point(u, s.point);
+  // Infinities and NaN
+  if (s.valid && ((s.point.x() - s.point.x() != 0.0) || (s.point.y() - s.point.y() != 0.0)))
+    s.valid = false;
+
+  return s;
+}
+
+void CurveSampler::addSample(const Sample &s)
+{
+  if (s.valid)
+    _polyline.addPoint(s.point);
+  else
+    _polyline.breakLine();
+}
+
+void CurveSampler::refine(const Sample &a, const Sample &b, int depth, double parentDistance)
+{
+  // Undefined on both ends; in the coarse intervals, the midpoint is still checked
+  if ((!a.valid) && (!b.valid) && (depth > 0))
+  {
+    addSample(b);
+    return;
+  }
+
+  double d = (a.valid && b.valid) ? distance(a.point, b.point) : 0.0;
+
+  /* An interval which hasn't shrunk much since the level above may contain a jump.
+     Even if it looks straight, it is subdivided until that is decided at the finest level. */
+  bool jump = (depth > 0) && (d > JUMP) && (d > JUMP_RATIO * parentDistance);
+
+  if ((!jump) && a.valid && b.valid && (d <= _minSegment))
+  {
+    addSample(b);
+    return;
+  }
+
+  if ((depth >= _maxDepth) || (_sampleCount >= _maxSamples))
+  {
+    if (jump && (depth >= MAX_DEPTH))
+      _polyline.breakLine();
+    // Not subdivided to the finest level, e.g. in a draft, so the jump is decided here
+    else if ((depth < MAX_DEPTH) && (_sampleCount < _maxSamples) && a.valid && b.valid &&
+             (d > JUMP) && jumps(a, b, depth))
+      _polyline.breakLine();
+    addSample(b);
+    return;
+  }
+
+  Sample m = evaluate(0.5 * (a.u + b.u));
+
+  if (a.valid && b.valid && m.valid)
+  {
+    // Off the area on one side, there's nothing to see in detail
+    if (outsideOnOneSide(a.point, m.point, b.point))
+    {
+      addSample(b);
+      return;
+    }
+
+    bool straight = (!jump) && (distanceFromLine(m.point, a.point, b.point) <= TOLERANCE) &&
+                    ((_maxSegment <= 0.0) || (d <= _maxSegment));
+
+    if (straight && (depth == 0))
+    {
+      Sample probe = evaluate(a.u + PROBE_POSITION * (b.u - a.u));
+      straight = probe.valid && (distanceFromLine(probe.point, a.point, b.point) <= TOLERANCE);
+    }
+
+    if (straight)
+    {
+      addSample(b);
+      return;
+    }
+  }
+
+  refine(a, m, depth + 1, d);
+  refine(m, b, depth + 1, d);
+}
+
+bool CurveSampler::jumps(Sample a, Sample b, int depth)
+{
+  double d = distance(a.point, b.point);
+
+  // The half with the larger distance is followed down to the finest level, as refine() would
+  for (; depth < MAX_DEPTH; ++depth)
+  {
+    Sample m = evaluate(0.5 * (a.u + b.u));
+    if (!m.valid)
+      return true;
+
+    double da = distance(a.point, m.point);
+    double db = distance(m.point, b.point);
+    if (da >= db)
+    {
+      b = m;
+    }
+    else
+    {
+      a = m;
+      da = db;
+    }
+
+    // Continuous, the distance halves at once
+    if ((da <= JUMP) || (da <= JUMP_RATIO * d))
+      return false;
+
+    d = da;
+  }
+
+  return true;
+}
+
+bool CurveSampler::outsideOnOneSide(const QPointF &a, const QPointF &m, const QPointF &b) const
+{
+  const QRectF &rect = _polyline.clipRect();
+
+  return ((a.y() < rect.top()) && (m.y() < rect.top()) && (b.y() < rect.top())) ||
+         ((a.y() > rect.bottom()) && (m.y() > rect.bottom()) && (b.y() > rect.bottom())) ||
+         ((a.x() < rect.left()) && (m.x() < rect.left()) && (b.x() < rect.left())) ||
+         ((a.x() > rect.right()) && (m.x() > rect.right()) && (b.x() > rect.right()));
+}
+
+
+// -------- SampleCache --------
+
+
+// Positions further than this (in units of the cache) can't be represented exactly
+const double MAX_CACHE_POSITION = 1e15;
+
+SampleCache::SampleCache()
+{
+  _scale = 0.0;
+  _revision = 0;
+  _variant = 0;
+}
+
+bool SampleCache::prepare(double scale, unsigned long revision, int variant)
+{
+  if ((scale == _scale) && (revision == _revision) && (variant == _variant))
+    return false;
+
+  _values.clear();
+  _scale = scale;
+  _revision = revision;
+  _variant = variant;
+  return true;
+}
+
+void SampleCache::clear()
+{
+  _values.clear();
+  _scale = 0.0;
+}
+
+bool SampleCache::key(double worldPixels, qint64 &result)
+{
+  double position = worldPixels * RESOLUTION;
+  if (!(fabs(position) < MAX_CACHE_POSITION))
+    return false;
+
+  double rounded = floor(position + 0.5);
+  if (fabs(position - rounded) > 1e-6)
+    return false;
+
+  result = static_cast<qint64>(rounded);
+  return true;
+}
+
+void SampleCache::prune(qint64 minKey, qint64 maxKey, int limit)
+{
+  if (_values.size() <= limit) return;
+
+  QHash<qint64, CachedValue>::iterator it = _values.begin();
+  while (it != _values.end())
+  {
+    if ((it.key() < minKey) || (it.key() > maxKey))
+      it = _values.erase(it);
+    else
+      ++it;
+  }
+}
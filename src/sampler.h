@@ -0,0 +1,174 @@
+/* sampler.h - defines the CurveSampler class, which adaptively samples plotted curves.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_SAMPLER_H
+#define _QMPLOT_SAMPLER_H
+
+#include "polyline.h"
+
+#include <QPointF>
+#include <QHash>
+
+
+//! \class CurveSource Abstract source of points of a curve for CurveSampler
+/** The curve is given as a function of one argument u (e.g. pixel column). */
+class CurveSource
+{
+  public:
+    virtual ~CurveSource() {}
+
+    //! Computes the point of the curve at \a u in pixel coordinates
+    /** Returns false if the curve is not defined at \a u. */
+    virtual bool point(double u, QPointF &result) = 0;
+};
+
+//! \class CurveSampler Samples a curve adaptively and adds the points to a PolylineBuilder
+/** The curve is first sampled on a coarse grid. Each interval of the grid is then
+  subdivided recursively as long as its midpoint deviates from the straight line
+  between its ends by more than a sub-pixel tolerance. Straight parts thus need few
+  evaluations and detailed parts get more than one sample per pixel.
+
+  Where the curve is undefined, the line is broken; the boundary is located by bisection.
+  Intervals which keep a large jump even at the finest subdivision are treated as
+  discontinuities and not joined, so there are no false vertical lines at asymptotes.
+  Parts of the curve outside of the clipping area of the polyline are not refined.
+
+  Optionally, intervals are also subdivided while their ends are too far apart,
+  and accepted without the check of the midpoint when the ends are very close.
+
+  The number of evaluations is limited by the depth of subdivision and
+  by a budget of samples per coarse interval. With the depth set to 0, only the coarse
+  grid is evaluated, which makes a cheap draft; intervals with a large distance between their
+  ends are still checked for a jump, so that a draft has no false lines at asymptotes either. */
+class CurveSampler
+{
+  public:
+    CurveSampler(CurveSource &vSource, PolylineBuilder &vPolyline);
+
+    //! Samples the curve for u in [\a uMin, \a uMax]
+    /** The coarse grid has the step \a coarseStep and passes through \a gridOrigin,
+        so that the samples are always taken at the same u for the same grid. */
+    void sample(double uMin, double uMax, double coarseStep, double gridOrigin);
+
+    //! Number of evaluations done by the last sample()
+    inline int sampleCount() const
+    { return _sampleCount; }
+
+    //! Sets the maximum depth of subdivision; 0 gives just the coarse grid
+    inline void setMaxDepth(int vMaxDepth)
+    { _maxDepth = vMaxDepth; }
+
+    //! Sets the limits of the distance between subsequent points, in pixels; 0 for no limit
+    /** Intervals shorter than \a vMinSegment are accepted as they are, and those longer than
+        \a vMaxSegment are subdivided. Needed for curves whose argument isn't a screen coordinate
+        (e.g. parametric ones), which can pass a long way between two samples, or very little. */
+    inline void setSegmentLimits(double vMinSegment, double vMaxSegment)
+    { _minSegment = vMinSegment; _maxSegment = vMaxSegment; }
+
+  private:
+    //! \struct Sample A point of the curve at a given argument
+    struct Sample
+    {
+      double u;
+      QPointF point;
+      bool valid;
+    };
+
+    //! Source of the curve
+    CurveSource &_source;
+    //! Where the points go
+    PolylineBuilder &_polyline;
+    //! Number of evaluations done so far
+    int _sampleCount;
+    //! Limit of evaluations for the current sample()
+    int _maxSamples;
+    //! Maximum depth of subdivision
+    int _maxDepth;
+    //! Segments shorter than this are accepted without a check, 0 for none
+    double _minSegment;
+    //! Longest accepted segment, 0 for no limit
+    double _maxSegment;
+
+    //! Evaluates the curve at \a u
+    Sample evaluate(double u);
+    //! Adds the end of an accepted interval to the polyline
+    void addSample(const Sample &s);
+    //! Recursively subdivides the interval between \a a and \a b and emits its points
+    /** \a parentDistance is the distance of ends of the interval one level up. */
+    void refine(const Sample &a, const Sample &b, int depth, double parentDistance);
+    //! Returns true if the curve jumps between \a a and \a b, an interval at \a depth
+    /** For intervals which aren't subdivided to the finest level. The midpoint is compared
+        to the ends, and only if it doesn't halve the distance, the larger half is checked
+        the same way. Continuous intervals thus cost one more sample. */
+    bool jumps(Sample a, Sample b, int depth);
+    //! Returns true if the points are all outside of the clipping area, on the same side of it
+    bool outsideOnOneSide(const QPointF &a, const QPointF &m, const QPointF &b) const;
+};
+
+//! \class SampleCache Cache of values of a function of one variable
+/** The values are kept at world coordinates aligned to the finest subdivision of
+  CurveSampler at the current scale, i.e. at integer multiples of 1/RESOLUTION of a pixel.
+  Such arguments are the same after panning, so the values computed before can be reused
+  and only the newly exposed parts of the plot need evaluation.
+
+  The cache is tied to a scale and a revision of the formula, see prepare(). */
+class SampleCache
+{
+  public:
+    //! Number of cached positions per pixel
+    static const int RESOLUTION = 16;
+
+    SampleCache();
+
+    //! Clears the cache if \a scale, \a revision or \a variant differ from the last call
+    /** Returns true if the cache was cleared. */
+    bool prepare(double scale, unsigned long revision, int variant);
+
+    //! Removes all values
+    void clear();
+
+    //! Returns the key for the world coordinate given in pixels (coordinate * scale)
+    /** Returns false if the position isn't aligned, i.e. it can't be cached. */
+    static bool key(double worldPixels, qint64 &result);
+
+    //! Finds the value for \a key, returns false if it isn't cached
+    inline bool lookup(qint64 key, double &value, bool &valid) const
+    {
+      QHash<qint64, CachedValue>::const_iterator it = _values.constFind(key);
+      if (it == _values.constEnd()) return false;
+      value = it.value().value;
+      valid = it.value().valid;
+      return true;
+    }
+
+    inline void insert(qint64 key, double value, bool valid)
+    {
+      CachedValue v;
+      v.value = value;
+      v.valid = valid;
+      _values.insert(key, v);
+    }
+
+    //! Removes values outside of the key range [\a minKey, \a maxKey] if the cache grew above \a limit
+    void prune(qint64 minKey, qint64 maxKey, int limit);
+
+  private:
+    //! \struct CachedValue Computed value and whether it was valid
+    struct CachedValue
+    {
+      double value;
+      bool valid;
+    };
+
+    QHash<qint64, CachedValue> _values;
+    //! Scale, revision and variant the values are computed for
+    double _scale;
+    unsigned long _revision;
+    int _variant;
+};
+
+#endif // _QMPLOT_SAMPLER_H
@@ -0,0 +1,231 @@
+/* tiffwriter.cpp - implements the TiffWriter class, which writes images of any size
+                    to TIFF files strip by strip.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#include "tiffwriter.h"
+
+#include <QImage>
+
+
+// Types of the fields of the directory
+const quint16 TIFF_SHORT = 3;
+const quint16 TIFF_LONG = 4;
+const quint16 TIFF_RATIONAL = 5;
+
+// Value of the compression field for PackBits
+const quint16 COMPRESSION_PACKBITS = 32773;
+// Number of fields in the directory
+const int DIRECTORY_FIELDS = 13;
+// Resolution written to the file, in dots per inch
+const quint32 RESOLUTION_DPI = 72;
+// Largest offset in the file
+const qint64 MAX_OFFSET = 0xFFFFFFFFLL;
+
+
+//! Appends \a value to \a data in little-endian byte order
+static void append16(QByteArray &data, quint16 value)
+{
+  data.append(static_cast<char>(value & 0xFF));
+  data.append(static_cast<char>(value >> 8));
+}
+
+//! Appends \a value to \a data in little-endian byte order
+static void append32(QByteArray &data, quint32 value)
+{
+  append16(data, static_cast<quint16>(value & 0xFFFF));
+  append16(data, static_cast<quint16>(value >> 16));
+}
+
+//! Appends a field of the directory; \a value is the value itself if it fits in 4 bytes, else its offset
+static void appendField(QByteArray &data, quint16 tag, quint16 type, quint32 count, quint32 value)
+{
+  append16(data, tag);
+  append16(data, type);
+  append32(data, count);
+  // Values shorter than 4 bytes are left-justified, which in little-endian is the same number
+  append32(data, value);
+}
+
+//! Appends \a count bytes at \a bytes, compressed with PackBits, to \a output
+static void packBits(const uchar *bytes, int count, QByteArray &output)
+{
+  int i = 0;
+  while (i < count)
+  {
+    int run = 1;
+    while ((i + run < count) && (run < 128) && (bytes[i + run] == bytes[i]))
+      ++run;
+
+    if (run >= 3)
+    {
+      output.append(static_cast<char>(1 - run));
+      output.append(static_cast<char>(bytes[i]));
+      i += run;
+    }
+    else
+    {
+      // Literal bytes up to the next run of three
+      int start = i;
+      while ((i < count) && (i - start < 128))
+      {
+        if ((i + 2 < count) && (bytes[i] == bytes[i + 1]) && (bytes[i] == bytes[i + 2]))
+          break;
+        ++i;
+      }
+      output.append(static_cast<char>(i - start - 1));
+      output.append(reinterpret_cast<const char*>(bytes + start), i - start);
+    }
+  }
+}
+
+TiffWriter::TiffWriter()
+{
+  _width = _height = _rowsPerStrip = 0;
+  _writtenRows = 0;
+}
+
+TiffWriter::~TiffWriter()
+{
+  if (_file.isOpen())
+    _file.close();
+}
+
+bool TiffWriter::open(const QString &fileName, int width, int height, int rowsPerStrip)
+{
+  if ((width <= 0) || (height <= 0) || (rowsPerStrip <= 0)) return false;
+
+  _file.setFileName(fileName);
+  if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+  _width = width;
+  _height = height;
+  _rowsPerStrip = rowsPerStrip;
+  _writtenRows = 0;
+  _stripOffsets.clear();
+  _stripSizes.clear();
+
+  // Little-endian header; the offset of the directory is set by close()
+  QByteArray header("II");
+  append16(header, 42);
+  append32(header, 0);
+
+  return _file.write(header) == header.size();
+}
+
+bool TiffWriter::writeStrip(const QImage &strip, int rows)
+{
+  if ((!_file.isOpen()) || (rows <= 0) || (_writtenRows + rows > _height) ||
+      (strip.width() != _width) || (strip.height() < rows))
+    return false;
+
+  QImage rgb = strip;
+  if ((rgb.format() != QImage::Format_RGB32) && (rgb.format() != QImage::Format_ARGB32))
+    rgb = rgb.convertToFormat(QImage::Format_RGB32);
+
+  // Each row is compressed on its own, as the format requires
+  _buffer.clear();
+  QByteArray row(3 * _width, 0);
+  uchar *rowBytes = reinterpret_cast<uchar*>(row.data());
+  for (int y = 0; y < rows; ++y)
+  {
+    const QRgb *line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+    for (int x = 0; x < _width; ++x)
+    {
+      rowBytes[3 * x] = static_cast<uchar>(qRed(line[x]));
+      rowBytes[3 * x + 1] = static_cast<uchar>(qGreen(line[x]));
+      rowBytes[3 * x + 2] = static_cast<uchar>(qBlue(line[x]));
+    }
+    packBits(rowBytes, row.size(), _buffer);
+  }
+
+  qint64 offset = _file.pos();
+  if (offset + _buffer.size() > MAX_OFFSET) return false;
+  if (_file.write(_buffer) != _buffer.size()) return false;
+
+  _stripOffsets.append(static_cast<quint32>(offset));
+  _stripSizes.append(static_cast<quint32>(_buffer.size()));
+  _writtenRows += rows;
+
+  return true;
+}
+
+bool TiffWriter::close()
+{
+  if (!_file.isOpen()) return false;
+
+  bool result = (_writtenRows == _height);
+
+  // The directory starts on a word boundary
+  if (result && (_file.pos() % 2 != 0))
+    result = (_file.write("", 1) == 1);
+
+  quint32 strips = static_cast<quint32>(_stripOffsets.size());
+  qint64 directoryOffset = _file.pos();
+  // Values which don't fit in the fields follow the directory
+  qint64 extraOffset = directoryOffset + 2 + 12 * DIRECTORY_FIELDS + 4;
+  qint64 bitsOffset = extraOffset;
+  qint64 resolutionOffset = bitsOffset + 6;
+  qint64 offsetsOffset = resolutionOffset + 8;
+  qint64 sizesOffset = offsetsOffset + ((strips > 1) ? 4 * strips : 0);
+  qint64 end = sizesOffset + ((strips > 1) ? 4 * strips : 0);
+  if (end > MAX_OFFSET)
+    result = false;
+
+  if (result)
+  {
+    QByteArray directory;
+    append16(directory, DIRECTORY_FIELDS);
+    // Fields are sorted by their tags
+    appendField(directory, 256, TIFF_LONG, 1, static_cast<quint32>(_width));
+    appendField(directory, 257, TIFF_LONG, 1, static_cast<quint32>(_height));
+    appendField(directory, 258, TIFF_SHORT, 3, static_cast<quint32>(bitsOffset));
+    appendField(directory, 259, TIFF_SHORT, 1, COMPRESSION_PACKBITS);
+    // RGB
+    appendField(directory, 262, TIFF_SHORT, 1, 2);
+    appendField(directory, 273, TIFF_LONG, strips,
+                (strips > 1) ? static_cast<quint32>(offsetsOffset) : _stripOffsets.first());
+    appendField(directory, 277, TIFF_SHORT, 1, 3);
+    appendField(directory, 278, TIFF_LONG, 1, static_cast<quint32>(_rowsPerStrip));
+    appendField(directory, 279, TIFF_LONG, strips,
+                (strips > 1) ? static_cast<quint32>(sizesOffset) : _stripSizes.first());
+    // Both resolutions are the same rational
+    appendField(directory, 282, TIFF_RATIONAL, 1, static_cast<quint32>(resolutionOffset));
+    appendField(directory, 283, TIFF_RATIONAL, 1, static_cast<quint32>(resolutionOffset));
+    // Samples of a pixel are together
+    appendField(directory, 284, TIFF_SHORT, 1, 1);
+    // Resolution is in inches
+    appendField(directory, 296, TIFF_SHORT, 1, 2);
+    // No next directory
+    append32(directory, 0);
+
+    append16(directory, 8);
+    append16(directory, 8);
+    append16(directory, 8);
+    append32(directory, RESOLUTION_DPI);
+    append32(directory, 1);
+    if (strips > 1)
+    {
+      for (quint32 i = 0; i < strips; ++i)
+        append32(directory, _stripOffsets.at(i));
+      for (quint32 i = 0; i < strips; ++i)
+        append32(directory, _stripSizes.at(i));
+    }
+
+    QByteArray header;
+    append32(header, static_cast<quint32>(directoryOffset));
+
+    result = (_file.write(directory) == directory.size()) && _file.seek(4) &&
+             (_file.write(header) == header.size());
+  }
+
+  _file.close();
+  _stripOffsets.clear();
+  _stripSizes.clear();
+  _buffer.clear();
+
+  return result;
+}
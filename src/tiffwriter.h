@@ -0,0 +1,56 @@
+/* tiffwriter.h - defines the TiffWriter class, which writes images of any size
+                  to TIFF files strip by strip.
+
+ This file is part of QMPlot licensed under GPLv2.
+
+ Copyright (C) Piotr Dziwinski 2009-2010
+*/
+
+#ifndef _QMPLOT_TIFFWRITER_H
+#define _QMPLOT_TIFFWRITER_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+class QImage;
+
+//! \class TiffWriter Writes an RGB image to a TIFF file in strips of rows, from top to bottom
+/** Only the strip being written is in memory, so the size of the image is limited only
+  by the file format (offsets in the file are 32-bit). Rows are compressed with PackBits,
+  which is cheap and works well for plots, where most rows are runs of a few colors.
+
+  The directory of the file is written after the strips by close(). */
+class TiffWriter
+{
+  public:
+    TiffWriter();
+    //! Closes the file if it's open, without finishing it
+    ~TiffWriter();
+
+    //! Creates the file \a fileName for an image of \a width x \a height and \a rowsPerStrip
+    /** All strips have \a rowsPerStrip rows, except the last one, which may have less.
+        Returns false if the file can't be created. */
+    bool open(const QString &fileName, int width, int height, int rowsPerStrip);
+
+    //! Writes the first \a rows rows of \a strip (of the image width) as the next strip
+    /** Returns false if the file can't be written. */
+    bool writeStrip(const QImage &strip, int rows);
+
+    //! Writes the directory of the file and closes it
+    /** Returns false if it can't be written or not all strips were written. */
+    bool close();
+
+  private:
+    QFile _file;
+    int _width, _height, _rowsPerStrip;
+    //! Rows written so far
+    int _writtenRows;
+    //! Offsets and sizes of the strips written so far
+    QVector<quint32> _stripOffsets, _stripSizes;
+    //! Buffer for the compressed strip
+    QByteArray _buffer;
+};
+
+#endif // _QMPLOT_TIFFWRITER_H
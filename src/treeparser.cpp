@@ -8,6 +8,7 @@
 #include "treeparser.h"
 
 #include <cerrno>
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
@@ -21,6 +22,8 @@ using namespace std;
    - argTypeForToken()
    - TreeParser::setExpression()
    - TreeParser::TreeNode::process()
+   - TreeParser::TreeNode::operate()
+   - TreeParser::TreeNode::processInterval()
 */
 
 
@@ -1225,136 +1228,166 @@ ComputeResult TreeParser::TokenNode::process(NumType &value, const PtrValueMap &
     // Should not happen
     case TT_Number:
     case TT_Variable:
+    case TT_None:
+    case TT_LeftBracket:
+    case TT_RightBracket:
+    case TT_Comma:
     {
       result.logicError = __LINE__;
       break;
     }
+    // Operations taking two arguments
     case TT_Add:
+    case TT_Subtract:
+    case TT_Multiply:
+    case TT_Divide:
+    case TT_Power:
+    case TT_Modulus:
+    case TT_Min:
+    case TT_Max:
     {
       if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
+        result = operate(thisToken, leftToken.number(), rightToken.number(), value);
+      break;
+    }
+    // Operations taking the left argument
+    case TT_Factorial:
+    {
+      if (leftToken.type() == TT_Number)
+        result = operate(thisToken, leftToken.number(), 0.0, value);
+      break;
+    }
+    case TT_ExternalFunction:
+    {
+      if (_getFunctionValue == NULL)
       {
-        value = leftToken.number() + rightToken.number();
-
-        ++result.expansions;
+        // Treat it as a double error
+        result.mathError = ME_DomainError;
+        result.logicError = __LINE__;
+        break;
       }
+
+      if (rightToken.type() == TT_Number)
+        result = operate(thisToken, 0.0, rightToken.number(), value);
       break;
     }
-    case TT_Plus:
+    // Operations taking the right argument
+    default:
     {
       if (rightToken.type() == TT_Number)
-      {
-        value = rightToken.number();
+        result = operate(thisToken, 0.0, rightToken.number(), value);
+      break;
+    }
+  }
 
-        ++result.expansions;
-      }
+  return result;
+}
+
+ComputeResult TreeParser::TokenNode::operate(const Token &operation, NumType left, NumType right, NumType &value)
+{
+  ComputeResult result;
+
+  switch (operation.type())
+  {
+    case TT_Add:
+    {
+      value = left + right;
+
+      ++result.expansions;
+      break;
+    }
+    case TT_Plus:
+    {
+      value = right;
+
+      ++result.expansions;
       break;
     }
     case TT_Subtract:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
-      {
-        value = leftToken.number() - rightToken.number();
+      value = left - right;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Minus:
     {
-      if (rightToken.type() == TT_Number)
-      {
-        value = -rightToken.number();
+      value = -right;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Multiply:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
-      {
-        value = leftToken.number() * rightToken.number();
+      value = left * right;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Divide:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
+      if (right == 0.0)
       {
-        if (rightToken.number() == 0.0)
-        {
-          result.mathError = ME_DivisionByZero;
-          break;
-        }
+        result.mathError = ME_DivisionByZero;
+        break;
+      }
 
-        value = leftToken.number() / rightToken.number();
+      value = left / right;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Power:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
-      {
-        // Reset errno
-        errno = 0;
-
-        value = pow(leftToken.number(), rightToken.number());
-        if (errno == ERANGE)
-        {
-          result.mathError = ME_RangeError;
-          break;
-        }
-        else if (errno == EDOM)
-        {
-          result.mathError = ME_DomainError;
-          break;
-        }
-        // Normally, there should not be any other errrors
-        else if (errno != 0)
-        {
-          result.logicError = __LINE__;
-          break;
-        }
+      // Reset errno
+      errno = 0;
 
-        ++result.expansions;
+      value = pow(left, right);
+      if (errno == ERANGE)
+      {
+        result.mathError = ME_RangeError;
+        break;
+      }
+      else if (errno == EDOM)
+      {
+        result.mathError = ME_DomainError;
+        break;
+      }
+      // Normally, there should not be any other errrors
+      else if (errno != 0)
+      {
+        result.logicError = __LINE__;
+        break;
       }
+
+      ++result.expansions;
       break;
     }
     case TT_Modulus:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
+      if (right == 0.0)
       {
-        if (rightToken.number() == 0.0)
-        {
-          result.mathError = ME_DivisionByZero;
-          break;
-        }
+        result.mathError = ME_DivisionByZero;
+        break;
+      }
 
-        value = fmod(leftToken.number(), rightToken.number());
+      value = fmod(left, right);
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Factorial:
     {
-      if (leftToken.type() == TT_Number)
+      if (left < 0.0)
       {
-        if (leftToken.number() < 0.0)
-        {
-          result.mathError = ME_DomainError;
-          break;
-        }
+        result.mathError = ME_DomainError;
+        break;
+      }
 
-        value = 1.0;
-        for (NumType i = 1.0; i < leftToken.number() + 1.0; ++i) value *= i;
+      value = 1.0;
+      for (NumType i = 1.0; i < left + 1.0; ++i) value *= i;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     // Functions computed using standard library
@@ -1375,74 +1408,72 @@ ComputeResult TreeParser::TokenNode::process(NumType &value, const PtrValueMap &
     case TT_Ceil:
     case TT_Floor:
     {
-      if (rightToken.type() != TT_Number) break;
-
       // Remember to reset errno
       errno = 0;
 
-      if (thisToken.type() == TT_Abs)
+      if (operation.type() == TT_Abs)
       {
-        value = fabs(rightToken.number());
+        value = fabs(right);
       }
-      else if (thisToken.type() == TT_Sqrt)
+      else if (operation.type() == TT_Sqrt)
       {
-        value = sqrt(rightToken.number());
+        value = sqrt(right);
       }
-      else if (thisToken.type() == TT_Exp)
+      else if (operation.type() == TT_Exp)
       {
-        value = exp(rightToken.number());
+        value = exp(right);
       }
-      else if (thisToken.type() == TT_Ln)
+      else if (operation.type() == TT_Ln)
       {
-        value = log(rightToken.number());
+        value = log(right);
       }
-      else if (thisToken.type() == TT_Log)
+      else if (operation.type() == TT_Log)
       {
-        value = log10(rightToken.number());
+        value = log10(right);
       }
-      else if (thisToken.type() == TT_Sin)
+      else if (operation.type() == TT_Sin)
       {
-        value = sin(rightToken.number());
+        value = sin(right);
       }
-      else if (thisToken.type() == TT_Cos)
+      else if (operation.type() == TT_Cos)
       {
-        value = cos(rightToken.number());
+        value = cos(right);
       }
-      else if (thisToken.type() == TT_Tan)
+      else if (operation.type() == TT_Tan)
       {
-        value = tan(rightToken.number());
+        value = tan(right);
       }
-      else if (thisToken.type() == TT_Asin)
+      else if (operation.type() == TT_Asin)
       {
-        value = asin(rightToken.number());
+        value = asin(right);
       }
-      else if (thisToken.type() == TT_Acos)
+      else if (operation.type() == TT_Acos)
       {
-        value = acos(rightToken.number());
+        value = acos(right);
       }
-      else if (thisToken.type() == TT_Atan)
+      else if (operation.type() == TT_Atan)
       {
-        value = atan(rightToken.number());
+        value = atan(right);
       }
-      else if (thisToken.type() == TT_Sinh)
+      else if (operation.type() == TT_Sinh)
       {
-        value = sinh(rightToken.number());
+        value = sinh(right);
       }
-      else if (thisToken.type() == TT_Cosh)
+      else if (operation.type() == TT_Cosh)
       {
-        value = cosh(rightToken.number());
+        value = cosh(right);
       }
-      else if (thisToken.type() == TT_Tanh)
+      else if (operation.type() == TT_Tanh)
       {
-        value = tanh(rightToken.number());
+        value = tanh(right);
       }
-      else if (thisToken.type() == TT_Ceil)
+      else if (operation.type() == TT_Ceil)
       {
-        value = ceil(rightToken.number());
+        value = ceil(right);
       }
-      else if (thisToken.type() == TT_Floor)
+      else if (operation.type() == TT_Floor)
       {
-        value = floor(rightToken.number());
+        value = floor(right);
       }
 
       // Handle errors (if any)
@@ -1468,36 +1499,30 @@ ComputeResult TreeParser::TokenNode::process(NumType &value, const PtrValueMap &
     }
     case TT_Signum:
     {
-      if (rightToken.type() == TT_Number)
-      {
-        value = 0.0;
-        if (rightToken.number() < 0.0) value = -1.0;
-        else if (rightToken.number() > 0.0) value = 1.0;
-        else value = 0.0;
+      value = 0.0;
+      if (right < 0.0) value = -1.0;
+      else if (right > 0.0) value = 1.0;
+      else value = 0.0;
 
-        ++result.expansions;
-      }
+      ++result.expansions;
       break;
     }
     case TT_Min:
     case TT_Max:
     {
-      if ((leftToken.type() == TT_Number) && (rightToken.type() == TT_Number))
+      if (operation.type() == TT_Min)
       {
-        if (thisToken.type() == TT_Min)
-        {
-          if (leftToken.number() < rightToken.number()) value = leftToken.number();
-          else value = rightToken.number();
-        }
-        // TT_Max
-        else
-        {
-          if (leftToken.number() < rightToken.number()) value = rightToken.number();
-          else value = leftToken.number();
-        }
-
-        ++result.expansions;
+        if (left < right) value = left;
+        else value = right;
+      }
+      // TT_Max
+      else
+      {
+        if (left < right) value = right;
+        else value = left;
       }
+
+      ++result.expansions;
       break;
     }
     case TT_ExternalFunction:
@@ -1510,15 +1535,14 @@ ComputeResult TreeParser::TokenNode::process(NumType &value, const PtrValueMap &
         break;
       }
 
-      if (rightToken.type() == TT_Number)
-      {
-        bool ok = _getFunctionValue(thisToken.name(), rightToken.number(), value);
-        if (!ok) result.mathError = ME_DomainError;
-        else ++result.expansions;
-      }
+      bool ok = _getFunctionValue(operation.name(), right, value);
+      if (!ok) result.mathError = ME_DomainError;
+      else ++result.expansions;
 
       break;
     }
+    case TT_Number:
+    case TT_Variable:
     case TT_None:
     case TT_LeftBracket:
     case TT_RightBracket:
@@ -1532,6 +1556,386 @@ ComputeResult TreeParser::TokenNode::process(NumType &value, const PtrValueMap &
   return result;
 }
 
+// Returns the interval of all numbers
+static inline Interval wholeLine()
+{
+  return Interval(-HUGE_VAL, HUGE_VAL);
+}
+
+// Returns the smallest interval containing the given values, or all numbers if any of them is NaN
+static Interval span(NumType a, NumType b, NumType c, NumType d)
+{
+  if ((a != a) || (b != b) || (c != c) || (d != d)) return wholeLine();
+
+  return Interval(min(min(a, b), min(c, d)), max(max(a, b), max(c, d)));
+}
+
+static inline Interval span(NumType a, NumType b)
+{
+  return span(a, b, a, b);
+}
+
+// Returns true if the interval contains some of the points offset + k * period
+static bool containsPeriodic(const Interval &x, NumType offset, NumType period)
+{
+  NumType k = ceil((x.lower - offset) / period);
+  return offset + k * period <= x.upper;
+}
+
+// Returns the product of the intervals
+static inline Interval multiply(const Interval &a, const Interval &b)
+{
+  return span(a.lower * b.lower, a.lower * b.upper, a.upper * b.lower, a.upper * b.upper);
+}
+
+ComputeResult TreeParser::TokenNode::computeInterval(Interval &value, const IntervalMap &intervals,
+                                                     const PtrValueMap &variables) const
+{
+  ComputeResult result;
+  if ((leftChild == NULL) && (rightChild == NULL))
+  {
+    if (tokens.front().type() == TT_Number)
+      value = Interval(tokens.front().number(), tokens.front().number());
+    else if (tokens.front().type() == TT_Variable)
+    {
+      ConstIntervalMapIterator intervalIt = intervals.find(tokens.front().name());
+      ConstPtrValueMapIterator it = variables.find(tokens.front().name());
+      if (intervalIt != intervals.end())
+        value = (*intervalIt).second;
+      else if (it != variables.end())
+        value = Interval(*((*it).second), *((*it).second));
+      else
+        result.variableError = true;
+    }
+    else
+      result.logicError = __LINE__;
+
+    return result;
+  }
+
+  Interval left;
+
+  if (leftChild != NULL)
+  {
+    ComputeResult childResult = leftChild->computeInterval(left, intervals, variables);
+    result.join(childResult);
+
+    if ((result.logicError != 0) || (result.mathError != 0) || result.variableError) return result;
+  }
+
+  Interval right;
+
+  if (rightChild != NULL)
+  {
+    ComputeResult childResult = rightChild->computeInterval(right, intervals, variables);
+    result.join(childResult);
+
+    if ((result.logicError != 0) || (result.mathError != 0) || result.variableError) return result;
+  }
+
+  ComputeResult processResult = processInterval(value, left, right);
+  result.join(processResult);
+
+  return result;
+}
+
+/* The ranges are computed from the monotonicity of the operations: the extremes are taken
+  at the ends of the arguments or at the known extremes of the function inside them.
+  Where the function is undefined for a part of the argument, only the rest is considered.
+  Where the range can't be bounded (e.g. division by an interval containing zero,
+  external functions), it is the whole line. */
+ComputeResult TreeParser::TokenNode::processInterval(Interval &value, const Interval &left,
+                                                     const Interval &right) const
+{
+  ComputeResult result;
+  const Token &thisToken = tokens.front();
+
+  switch (thisToken.type())
+  {
+    // Should not happen
+    case TT_Number:
+    case TT_Variable:
+    case TT_None:
+    case TT_LeftBracket:
+    case TT_RightBracket:
+    case TT_Comma:
+    {
+      result.logicError = __LINE__;
+      return result;
+    }
+    case TT_Add:
+    {
+      value = Interval(left.lower + right.lower, left.upper + right.upper);
+      break;
+    }
+    case TT_Plus:
+    {
+      value = right;
+      break;
+    }
+    case TT_Subtract:
+    {
+      value = Interval(left.lower - right.upper, left.upper - right.lower);
+      break;
+    }
+    case TT_Minus:
+    {
+      value = Interval(-right.upper, -right.lower);
+      break;
+    }
+    case TT_Multiply:
+    {
+      value = multiply(left, right);
+      break;
+    }
+    case TT_Divide:
+    {
+      if ((right.lower == 0.0) && (right.upper == 0.0))
+      {
+        result.mathError = ME_DivisionByZero;
+        return result;
+      }
+
+      if (right.lower == 0.0)
+        value = multiply(left, Interval(1.0 / right.upper, HUGE_VAL));
+      else if (right.upper == 0.0)
+        value = multiply(left, Interval(-HUGE_VAL, 1.0 / right.lower));
+      else if (right.contains(0.0))
+        value = wholeLine();
+      else
+        value = multiply(left, Interval(1.0 / right.upper, 1.0 / right.lower));
+      break;
+    }
+    case TT_Power:
+    {
+      NumType exponent = right.lower;
+
+      // Constant integer exponent: the base can be negative
+      if ((right.lower == right.upper) && (exponent == floor(exponent)) && (fabs(exponent) < 1e9))
+      {
+        bool even = (fmod(exponent, 2.0) == 0.0);
+        NumType a = pow(left.lower, exponent);
+        NumType b = pow(left.upper, exponent);
+
+        if (exponent == 0.0)
+          value = Interval(1.0, 1.0);
+        else if (!left.contains(0.0))
+          value = span(a, b);
+        else if (exponent > 0.0)
+          value = even ? Interval(0.0, max(a, b)) : Interval(a, b);
+        else if ((left.lower == 0.0) && (left.upper == 0.0))
+        {
+          result.mathError = ME_RangeError;
+          return result;
+        }
+        else
+          value = even ? Interval(min(a, b), HUGE_VAL) : wholeLine();
+        break;
+      }
+
+      // Negative bases are allowed only with integer exponents
+      if (left.lower < 0.0)
+      {
+        if ((left.upper < 0.0) && (floor(right.upper) < right.lower))
+        {
+          result.mathError = ME_DomainError;
+          return result;
+        }
+
+        value = wholeLine();
+        break;
+      }
+
+      // pow() is monotonic in both arguments for non-negative bases
+      value = span(pow(left.lower, right.lower), pow(left.lower, right.upper),
+                   pow(left.upper, right.lower), pow(left.upper, right.upper));
+      break;
+    }
+    case TT_Modulus:
+    {
+      if ((right.lower == 0.0) && (right.upper == 0.0))
+      {
+        result.mathError = ME_DivisionByZero;
+        return result;
+      }
+
+      // The result has the sign of the dividend and is smaller than the divisor
+      NumType bound = max(fabs(right.lower), fabs(right.upper));
+      value = Interval((left.lower >= 0.0) ? 0.0 : max(-bound, left.lower),
+                       (left.upper <= 0.0) ? 0.0 : min(bound, left.upper));
+      break;
+    }
+    case TT_Factorial:
+    {
+      if (left.upper < 0.0)
+      {
+        result.mathError = ME_DomainError;
+        return result;
+      }
+
+      // The factorial (computed as in process()) grows with the argument
+      NumType bounds[2] = { max(left.lower, 0.0), left.upper };
+      for (int k = 0; k < 2; ++k)
+      {
+        if (bounds[k] > 171.0)
+        {
+          bounds[k] = HUGE_VAL;
+          continue;
+        }
+
+        NumType f = 1.0;
+        for (NumType i = 1.0; i < bounds[k] + 1.0; ++i) f *= i;
+        bounds[k] = f;
+      }
+      value = Interval(bounds[0], bounds[1]);
+      break;
+    }
+    case TT_Abs:
+    {
+      if (right.contains(0.0))
+        value = Interval(0.0, max(fabs(right.lower), fabs(right.upper)));
+      else
+        value = span(fabs(right.lower), fabs(right.upper));
+      break;
+    }
+    case TT_Sqrt:
+    {
+      if (right.upper < 0.0)
+      {
+        result.mathError = ME_DomainError;
+        return result;
+      }
+
+      value = Interval(sqrt(max(right.lower, 0.0)), sqrt(right.upper));
+      break;
+    }
+    case TT_Ln:
+    case TT_Log:
+    {
+      if (right.upper <= 0.0)
+      {
+        result.mathError = ME_DomainError;
+        return result;
+      }
+
+      if (thisToken.type() == TT_Ln)
+        value = Interval((right.lower > 0.0) ? log(right.lower) : -HUGE_VAL, log(right.upper));
+      else
+        value = Interval((right.lower > 0.0) ? log10(right.lower) : -HUGE_VAL, log10(right.upper));
+      break;
+    }
+    case TT_Sin:
+    case TT_Cos:
+    {
+      if (!(right.upper - right.lower < 2.0 * M_PI))
+      {
+        value = Interval(-1.0, 1.0);
+        break;
+      }
+
+      // Positions of the maxima; the minima are shifted by pi
+      NumType maximum = (thisToken.type() == TT_Sin) ? M_PI / 2.0 : 0.0;
+      if (thisToken.type() == TT_Sin)
+        value = span(sin(right.lower), sin(right.upper));
+      else
+        value = span(cos(right.lower), cos(right.upper));
+
+      if (containsPeriodic(right, maximum, 2.0 * M_PI))
+        value.upper = 1.0;
+      if (containsPeriodic(right, maximum + M_PI, 2.0 * M_PI))
+        value.lower = -1.0;
+      break;
+    }
+    case TT_Tan:
+    {
+      if ((!(right.upper - right.lower < M_PI)) || containsPeriodic(right, M_PI / 2.0, M_PI))
+        value = wholeLine();
+      else
+        value = span(tan(right.lower), tan(right.upper));
+      break;
+    }
+    case TT_Asin:
+    case TT_Acos:
+    {
+      if ((right.upper < -1.0) || (right.lower > 1.0))
+      {
+        result.mathError = ME_DomainError;
+        return result;
+      }
+
+      NumType lower = max(right.lower, -1.0);
+      NumType upper = min(right.upper, 1.0);
+      if (thisToken.type() == TT_Asin)
+        value = Interval(asin(lower), asin(upper));
+      else
+        value = Interval(acos(upper), acos(lower));
+      break;
+    }
+    case TT_Cosh:
+    {
+      if (right.contains(0.0))
+        value = Interval(1.0, max(cosh(right.lower), cosh(right.upper)));
+      else
+        value = span(cosh(right.lower), cosh(right.upper));
+      break;
+    }
+    // Non-decreasing functions
+    case TT_Exp:
+    case TT_Atan:
+    case TT_Sinh:
+    case TT_Tanh:
+    case TT_Ceil:
+    case TT_Floor:
+    case TT_Signum:
+    {
+      NumType bounds[2] = { right.lower, right.upper };
+      for (int k = 0; k < 2; ++k)
+      {
+        NumType x = bounds[k];
+        if (thisToken.type() == TT_Exp)
+          bounds[k] = exp(x);
+        else if (thisToken.type() == TT_Atan)
+          bounds[k] = atan(x);
+        else if (thisToken.type() == TT_Sinh)
+          bounds[k] = sinh(x);
+        else if (thisToken.type() == TT_Tanh)
+          bounds[k] = tanh(x);
+        else if (thisToken.type() == TT_Ceil)
+          bounds[k] = ceil(x);
+        else if (thisToken.type() == TT_Floor)
+          bounds[k] = floor(x);
+        else
+          bounds[k] = (x < 0.0) ? -1.0 : ((x > 0.0) ? 1.0 : 0.0);
+      }
+      value = span(bounds[0], bounds[1]);
+      break;
+    }
+    case TT_Min:
+    {
+      value = Interval(min(left.lower, right.lower), min(left.upper, right.upper));
+      break;
+    }
+    case TT_Max:
+    {
+      value = Interval(max(left.lower, right.lower), max(left.upper, right.upper));
+      break;
+    }
+    // Nothing is known about external functions
+    case TT_ExternalFunction:
+    {
+      value = wholeLine();
+      break;
+    }
+  }
+
+  // Sums of opposite infinities
+  if (value.lower != value.lower) value.lower = -HUGE_VAL;
+  if (value.upper != value.upper) value.upper = HUGE_VAL;
+
+  ++result.expansions;
+  return result;
+}
+
 TreeParser::TreeParser() : _isShallowCopy(false)
 {
   init();
@@ -1540,10 +1944,12 @@ TreeParser::TreeParser() : _isShallowCopy(false)
 /* private */ TreeParser::TreeParser(bool copy) : _isShallowCopy(copy)
 {
   _root = NULL;
+  _revision = 0;
 }
 
 void TreeParser::init()
 {
+  _revision = 0;
   _root = new TokenNode();
   Token zero(TT_Number, 0.0);
   _root->tokens.push_back(zero);
@@ -1576,6 +1982,7 @@ TreeParser* TreeParser::shallowCopy() const
   result->_root = _root;
   result->_originalExpression = _originalExpression;
   result->_status = _status;
+  result->_revision = _revision;
   result->_variables = _variables;
   return result;
 }
@@ -1586,6 +1993,7 @@ TreeParser* TreeParser::deepCopy() const
   result->_root = _root->copy();
   result->_originalExpression = _originalExpression;
   result->_status = _status;
+  result->_revision = _revision;
   result->_variables = _variables;
   return result;
 }
@@ -1606,6 +2014,7 @@ void TreeParser::reset()
   static const Token zero(TT_Number, 0);
   _root->tokens.push_back(zero);
   _status.reset();
+  ++_revision;
 }
 
 bool TreeParser::setExpression(const std::string &expr)
@@ -2109,6 +2518,7 @@ void TreeParser::substitute()
 {
   if (_status.error == PE_None)
     _root->substitute(_constants);
+  ++_revision;
 }
 
 ComputeResult TreeParser::computeExpressionStep()
@@ -2119,6 +2529,7 @@ ComputeResult TreeParser::computeExpressionStep()
   else
     result.mathError = ME_InvalidExpression;
 
+  ++_revision;
   return result;
 }
 
@@ -2130,6 +2541,7 @@ ComputeResult TreeParser::computeExpression()
   else
     result.mathError = ME_InvalidExpression;
 
+  ++_revision;
   return result;
 }
 
@@ -2144,9 +2556,224 @@ ComputeResult TreeParser::computeValue(NumType &value) const
   return result;
 }
 
+ComputeResult TreeParser::computeInterval(Interval &value, const IntervalMap &intervals) const
+{
+  ComputeResult result;
+  if (_status.error == PE_None)
+    result = _root->computeInterval(value, intervals, _variables);
+  else
+    result.mathError = ME_InvalidExpression;
+
+  return result;
+}
+
 // Default values of static variables
 NumberFormat TreeParser::_numberFormat = NF_Auto;
 int TreeParser::_numberPrecision = 6;
 ValueMap TreeParser::_constants = ValueMap();
 bool (*TreeParser::_isFunction)(const std::string&) = NULL;
 bool (*TreeParser::_getFunctionValue)(const std::string&, NumType, NumType&) = NULL;
+
+
+//! Computes the sine and cosine of \a x together, with the errors as in TokenNode::operate()
+static ComputeResult sineCosine(NumType x, NumType &sine, NumType &cosine)
+{
+  ComputeResult result;
+
+  errno = 0;
+
+#ifdef __GLIBC__
+  sincos(x, &sine, &cosine);
+#else
+  sine = sin(x);
+  cosine = cos(x);
+#endif
+
+  if (errno == ERANGE)
+    result.mathError = ME_RangeError;
+  else if (errno == EDOM)
+    result.mathError = ME_DomainError;
+  else if (errno != 0)
+    result.logicError = __LINE__;
+  else
+    result.expansions += 2;
+
+  return result;
+}
+
+bool ExpressionProgram::NodeKey::operator<(const NodeKey &other) const
+{
+  if (type != other.type) return type < other.type;
+  if (left != other.left) return left < other.left;
+  if (right != other.right) return right < other.right;
+  return name < other.name;
+}
+
+ExpressionProgram::ExpressionProgram()
+{
+  _valid = true;
+}
+
+bool ExpressionProgram::addExpression(const TreeParser &parser)
+{
+  int result = -1;
+  if (parser._status.error == PE_None)
+    result = compileNode(parser._root);
+
+  if (result < 0)
+  {
+    _valid = false;
+    return false;
+  }
+
+  _outputs.push_back(result);
+  return true;
+}
+
+NumType* ExpressionProgram::variable(const std::string &name)
+{
+  NodeKey key;
+  key.type = TT_Variable;
+  key.name = name;
+  key.left = key.right = -1;
+
+  std::map<NodeKey, int>::const_iterator it = _nodes.find(key);
+  if (it == _nodes.end()) return NULL;
+
+  return &_registers[(*it).second];
+}
+
+ComputeResult ExpressionProgram::compute(NumType *outputs)
+{
+  ComputeResult result;
+  if (!_valid)
+  {
+    result.mathError = ME_InvalidExpression;
+    return result;
+  }
+
+  for (unsigned int i = 0; i < _operations.size(); ++i)
+  {
+    const Operation &operation = _operations[i];
+    NumType left = (operation.left >= 0) ? _registers[operation.left] : 0.0;
+    NumType right = (operation.right >= 0) ? _registers[operation.right] : 0.0;
+
+    if (operation.cosineResult >= 0)
+      result.join(sineCosine(right, _registers[operation.result], _registers[operation.cosineResult]));
+    else
+      result.join(TreeParser::TokenNode::operate(operation.token, left, right, _registers[operation.result]));
+
+    if ((result.logicError != 0) || (result.mathError != 0)) return result;
+  }
+
+  for (unsigned int i = 0; i < _outputs.size(); ++i)
+    outputs[i] = _registers[_outputs[i]];
+
+  return result;
+}
+
+int ExpressionProgram::addRegister(NumType value, int producer)
+{
+  _registers.push_back(value);
+  _producers.push_back(producer);
+  return _registers.size() - 1;
+}
+
+int ExpressionProgram::compileNode(const TreeParser::TokenNode *node)
+{
+  if (node->tokens.size() != 1) return -1;
+
+  const Token &token = node->tokens.front();
+
+  NodeKey key;
+  key.type = token.type();
+  key.left = key.right = -1;
+
+  if ((node->leftChild == NULL) && (node->rightChild == NULL))
+  {
+    NumType value = 0.0;
+    if (token.type() == TT_Number)
+    {
+      // The bytes tell apart also 0 and -0
+      value = token.number();
+      key.name.assign(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    else if (token.type() == TT_Variable)
+      key.name = token.name();
+    else
+      return -1;
+
+    std::map<NodeKey, int>::const_iterator it = _nodes.find(key);
+    if (it != _nodes.end()) return (*it).second;
+
+    int reg = addRegister(value, -1);
+    _nodes.insert(std::make_pair(key, reg));
+    return reg;
+  }
+
+  if (node->leftChild != NULL)
+  {
+    key.left = compileNode(node->leftChild);
+    if (key.left < 0) return -1;
+  }
+
+  if (node->rightChild != NULL)
+  {
+    key.right = compileNode(node->rightChild);
+    if (key.right < 0) return -1;
+  }
+
+  // Unary plus doesn't change the value
+  if (token.type() == TT_Plus) return key.right;
+
+  // Sums and products don't depend on the order of the arguments
+  if (((token.type() == TT_Add) || (token.type() == TT_Multiply)) && (key.left > key.right))
+    std::swap(key.left, key.right);
+
+  if (token.type() == TT_ExternalFunction)
+    key.name = token.name();
+
+  std::map<NodeKey, int>::const_iterator it = _nodes.find(key);
+  if (it != _nodes.end()) return (*it).second;
+
+  int reg = addRegister(0.0, _operations.size());
+  _nodes.insert(std::make_pair(key, reg));
+
+  // The sine or cosine of an argument whose cosine or sine is computed already joins that operation
+  if ((token.type() == TT_Sin) || (token.type() == TT_Cos))
+  {
+    NodeKey otherKey = key;
+    otherKey.type = (token.type() == TT_Sin) ? TT_Cos : TT_Sin;
+
+    it = _nodes.find(otherKey);
+    if (it != _nodes.end())
+    {
+      int producer = _producers[(*it).second];
+      Operation &other = _operations[producer];
+      if (other.cosineResult < 0)
+      {
+        if (token.type() == TT_Sin)
+        {
+          other.token = token;
+          other.cosineResult = other.result;
+          other.result = reg;
+        }
+        else
+          other.cosineResult = reg;
+
+        _producers[reg] = producer;
+        return reg;
+      }
+    }
+  }
+
+  Operation operation;
+  operation.token = token;
+  operation.left = key.left;
+  operation.right = key.right;
+  operation.result = reg;
+  operation.cosineResult = -1;
+  _operations.push_back(operation);
+
+  return reg;
+}
@@ -304,6 +304,30 @@ struct ComputeResult
   bool variableError;
 };
 
+//! A closed range of values [lower, upper]; the bounds can be infinite
+/** Used in interval evaluation, see TreeParser::computeInterval() */
+struct Interval
+{
+  Interval()
+    { lower = upper = 0.0; }
+
+  Interval(NumType vLower, NumType vUpper)
+    { lower = vLower; upper = vUpper; }
+
+  //! Returns true if the value is inside the interval
+  inline bool contains(NumType value) const
+    { return (lower <= value) && (value <= upper); }
+
+  //! Returns true if the interval has common values with [\a otherLower, \a otherUpper]
+  inline bool intersects(NumType otherLower, NumType otherUpper) const
+    { return (lower <= otherUpper) && (otherLower <= upper); }
+
+  NumType lower, upper;
+};
+
+typedef std::map<std::string, Interval> IntervalMap;
+typedef std::map<std::string, Interval>::const_iterator ConstIntervalMapIterator;
+
 //! \class TreeParser Main parser class
 /** TreeParser is a parser and evaluator of mathematical expressions. What it does basically is, given the string
    "(2-6)*4 + 8" will parse it, splitting the expression into symbols (tokens) in a tree structure (hence the name)
@@ -362,6 +386,14 @@ class TreeParser
       //! Processes the node by computing the value of the operation
       ComputeResult process(NumType &value, const PtrValueMap &variables,
                             NumType *leftValue = 0, NumType *rightValue = 0) const;
+      //! Does the operation \a operation on the values of its arguments (unused ones are ignored)
+      static ComputeResult operate(const Token &operation, NumType left, NumType right, NumType &value);
+
+      //! Computes the range of values of the expression over the given ranges of variables
+      ComputeResult computeInterval(Interval &value, const IntervalMap &intervals,
+                                    const PtrValueMap &variables) const;
+      //! Processes the node on ranges of arguments, see computeInterval()
+      ComputeResult processInterval(Interval &value, const Interval &left, const Interval &right) const;
     };
 
     //! Private constructor to support copying
@@ -369,6 +401,9 @@ class TreeParser
     void init();
 
 
+    //! Compiles the token trees, see ExpressionProgram
+    friend class ExpressionProgram;
+
     /** Copy constructor and assignment operator are currently blocked.
        If you want to have a copy of the object - use the functions
        shallowCopy() deepCopy(). */
@@ -404,6 +439,11 @@ class TreeParser
     inline ParseStatus status() const
       { return _status; }
 
+    /** Returns the revision of the expression - a number which changes every time the token
+      tree changes; can be used to tell whether values cached from the expression are stale */
+    inline unsigned long revision() const
+      { return _revision; }
+
     //! Returns a list of names of all variables in expression; the names can repeat
     std::vector<std::string> variablesInExpression() const;
     //! As above, returns a list of all external functions in expression
@@ -467,6 +507,11 @@ class TreeParser
     ComputeResult computeExpressionStep();
     //! Computes only the value of the expression without removing any tokens
     ComputeResult computeValue(NumType &value) const;
+    /** Computes a range which contains all values of the expression when the variables
+      take any values from the ranges in \a intervals; variables not given there have
+      their current values. The range may be wider than the real one, but never narrower.
+      If the expression is undefined for all the values, ME_DomainError is returned. */
+    ComputeResult computeInterval(Interval &value, const IntervalMap &intervals) const;
 
     //! Prints the token tree as 'dot' graph
     void print(std::ostream &out = std::cout) const;
@@ -494,6 +539,8 @@ class TreeParser
     std::string _originalExpression;
     //! Status of the parsing process
     ParseStatus _status;
+    //! Revision of the expression, see revision()
+    unsigned long _revision;
     //! Map of variables (local)
     PtrValueMap _variables;
 
@@ -512,4 +559,76 @@ class TreeParser
     static bool (*_getFunctionValue)(const std::string &func, NumType x, NumType &value);
 };
 
+//! \class ExpressionProgram Expressions compiled together into a list of operations
+/** The token trees of one or more TreeParsers are flattened into operations on an array of
+   registers, which compute() does in order, giving the values of all the expressions at once.
+   Equal subexpressions are computed only once, also when they are parts of different
+   expressions (e.g. r(t) in r(t)*cos(t) and r(t)*sin(t)), and the sine and cosine of the same
+   argument are computed together.
+
+   The values and errors are the same as those of TreeParser::computeValue(), but the variables
+   aren't taken from pointers: they are registers of the program, see variable(). So a copy of
+   the program is independent of the original and of the parsers it was compiled from. */
+class ExpressionProgram
+{
+  public:
+    ExpressionProgram();
+
+    /** Compiles the expression of \a parser as the next output; returns false if the expression
+      isn't parsed correctly, and then compute() always fails */
+    bool addExpression(const TreeParser &parser);
+
+    //! Returns the number of expressions (outputs) in the program
+    inline int outputCount() const
+      { return _outputs.size(); }
+
+    /** Returns the register of the variable \a name, to be set before compute(), or NULL if no
+      expression uses it; the pointer is valid until the next addExpression() */
+    NumType* variable(const std::string &name);
+
+    /** Computes the values of all the expressions into \a outputs, in the order they were added;
+      if any of them fails, the error is returned and the outputs are undefined */
+    ComputeResult compute(NumType *outputs);
+
+  private:
+    //! An operation of the program
+    struct Operation
+    {
+      //! The operation, as in the token tree
+      Token token;
+      //! Registers of the arguments (-1 if not used) and of the result
+      int left, right, result;
+      //! For fused sine and cosine (the token is TT_Sin), the register of the cosine; -1 otherwise
+      int cosineResult;
+    };
+
+    //! Identifies the computed nodes, to find the equal ones
+    struct NodeKey
+    {
+      TokenType type;
+      //! Name of the variable or external function, or the bytes of the number
+      std::string name;
+      int left, right;
+
+      bool operator<(const NodeKey &other) const;
+    };
+
+    //! Registers with the constants, variables and results of the operations
+    std::vector<NumType> _registers;
+    std::vector<Operation> _operations;
+    //! Registers of the values of the expressions
+    std::vector<int> _outputs;
+    //! Registers of the computed nodes
+    std::map<NodeKey, int> _nodes;
+    //! Index of the operation computing each register, -1 for constants and variables
+    std::vector<int> _producers;
+    //! False if one of the expressions couldn't be compiled
+    bool _valid;
+
+    //! Compiles the node and its children and returns the register of its value, or -1 on error
+    int compileNode(const TreeParser::TokenNode *node);
+    //! Adds a register with \a value, computed by the operation \a producer (-1 if none)
+    int addRegister(NumType value, int producer);
+};
+
 #endif // _QMPLOT_TREEPARSER_H